@@ -0,0 +1,310 @@
+/** Benchmarks of the scan parsing and matching
+ *
+ *  Purpose: keep the per cycle cost of turning a scan into detections
+ *  visible. Every benchmark runs on synthetic "iwlist scan" output of 10
+ *  to 2000 access points, filtered like ssid_network_scan() does, with
+ *  ssids of every length, hidden networks, and \xNN escapes and quotes
+ *  in the names. The phone network is the last cell, the worst case for
+ *  a search.
+ *
+ *  Throughput is reported in bytes/s of scan text and BSS/s.
+ *
+ *  BM_SteadyStateCycle runs the detector's DetectionCycle and also counts
+ *  its heap allocations, through malloc so the C library is counted too,
+ *  and fails when a cycle after the warm-up allocates at all. The same
+ *  check runs with a moving robot in test/test_detection_cycle.cpp.
+ *
+ *  Run: rosrun detectssid detectssid_bench
+ *
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>           // snprintf, remove
+#include <cstdlib>          // malloc
+#include <fstream>          // ofstream
+#include <memory>           // shared_ptr
+#include <string>
+#include <vector>
+#include <unistd.h>         // getpid
+
+#include "detectssid/bss.h"
+#include "detectssid/detection_cycle.h"
+#include "detectssid/detector.h"
+#include "detectssid/scan_backend.h"
+#include "detectssid/scan_config.h"
+
+/// heap allocations of the whole process, operator new included
+std::atomic<uint64_t> g_allocations(0);
+
+// glibc's own allocator under a counting malloc
+extern "C" void* __libc_malloc(std::size_t size);
+extern "C" void* __libc_calloc(std::size_t n, std::size_t size);
+extern "C" void* __libc_realloc(void* p, std::size_t size);
+
+extern "C" void* malloc(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(std::size_t n, std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* p, std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+
+namespace
+{
+
+const char kTarget[] = "PhoneArtifact";
+
+/**
+ * @brief Synthetic scan text of cells access points
+ *
+ * Deterministic, the same cells always give the same text.
+ */
+std::string make_scan_text(int cells)
+{
+    std::string text;
+    uint32_t seed = 12345;
+    char line[256];
+
+    for(int i = 0; i < cells; ++i){
+        seed = seed * 1103515245u + 12345u;
+        uint32_t r = seed >> 8;
+
+        snprintf(line, sizeof(line), "          Cell %02d - Address: %02X:%02X:%02X:%02X:%02X:%02X\n",
+                 i + 1, 0x02, (r >> 16) & 0xff, (r >> 8) & 0xff, r & 0xff, (i >> 8) & 0xff, i & 0xff);
+        text += line;
+        snprintf(line, sizeof(line), "                    Quality=%d/70  Signal level=%d dBm  \n",
+                 (int)(r % 70), -30 - (int)(r % 60));
+        text += line;
+
+        // every length up to 32 bytes, some hidden, some escaped or quoted
+        std::string ssid;
+        if(i == cells - 1){
+            ssid = std::string(kTarget) + "42";
+        }
+        else if(r % 11 != 0){
+            std::size_t len = 1 + r % 32;
+            for(std::size_t k = 0; k < len; ++k){
+                seed = seed * 1103515245u + 12345u;
+                uint32_t c = (seed >> 16) % 100;
+                if(c < 4){
+                    snprintf(line, sizeof(line), "\\x%02X", (unsigned)(seed >> 24));
+                    ssid += line;
+                }
+                else if(c < 6){
+                    ssid += '"';
+                }
+                else{
+                    ssid += (char)('a' + c % 26);
+                }
+            }
+        }
+        text += "                    ESSID:\"" + ssid + "\"\n";
+
+        snprintf(line, sizeof(line), "                    Extra: Last beacon: %dms ago\n", (int)(r % 5000));
+        text += line;
+    }
+
+    return text;
+}
+
+
+void set_throughput(benchmark::State& state, std::size_t bytes, int cells)
+{
+    state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)bytes);
+    state.counters["BSS/s"] = benchmark::Counter((double)state.iterations() * cells,
+                                                 benchmark::Counter::kIsRate);
+}
+
+
+/// the detector before the bss records: the whole file is read and searched
+void BM_SearchForPhoneSsid(benchmark::State& state)
+{
+    int cells = (int)state.range(0);
+    std::string text = make_scan_text(cells);
+
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/tmp/detectssid_bench_%d.txt", (int)getpid());
+    {
+        std::ofstream out(filename);
+        out << text;
+    }
+
+    std::string network;
+    for(auto _ : state){
+        bool found = detectssid::search_for_phone_ssid(filename, kTarget, network);
+        benchmark::DoNotOptimize(found);
+    }
+    remove(filename);
+    set_throughput(state, text.size(), cells);
+}
+BENCHMARK(BM_SearchForPhoneSsid)->Arg(10)->Arg(100)->Arg(500)->Arg(2000);
+
+
+void BM_ParseIwlistScan(benchmark::State& state)
+{
+    int cells = (int)state.range(0);
+    std::string text = make_scan_text(cells);
+
+    std::vector<detectssid::BssRecord> records;
+    for(auto _ : state){
+        std::size_t n = detectssid::parse_iwlist_scan(text.data(), text.size(), records);
+        benchmark::DoNotOptimize(n);
+    }
+    set_throughput(state, text.size(), cells);
+}
+BENCHMARK(BM_ParseIwlistScan)->Arg(10)->Arg(100)->Arg(500)->Arg(2000);
+
+
+void BM_SearchBssRecords(benchmark::State& state)
+{
+    int cells = (int)state.range(0);
+    std::string text = make_scan_text(cells);
+    std::vector<detectssid::BssRecord> records;
+    detectssid::parse_iwlist_scan(text.data(), text.size(), records);
+
+    std::string network;
+    for(auto _ : state){
+        std::size_t index = 0;
+        bool found = detectssid::search_bss_records(records, kTarget, network, index);
+        benchmark::DoNotOptimize(found);
+    }
+    set_throughput(state, text.size(), cells);
+}
+BENCHMARK(BM_SearchBssRecords)->Arg(10)->Arg(100)->Arg(500)->Arg(2000);
+
+
+void BM_TargetMatcherSearch(benchmark::State& state)
+{
+    int cells = (int)state.range(0);
+    std::string text = make_scan_text(cells);
+    std::vector<detectssid::BssRecord> records;
+    detectssid::parse_iwlist_scan(text.data(), text.size(), records);
+
+    detectssid::TargetMatcher matcher(kTarget);
+    std::string network;
+    for(auto _ : state){
+        std::size_t index = 0;
+        bool found = matcher.search(records, network, index);
+        benchmark::DoNotOptimize(found);
+    }
+    set_throughput(state, text.size(), cells);
+}
+BENCHMARK(BM_TargetMatcherSearch)->Arg(10)->Arg(100)->Arg(500)->Arg(2000);
+
+
+/// what a cycle does between the scan and the detections, from the file on
+void BM_ReadParseMatch(benchmark::State& state)
+{
+    int cells = (int)state.range(0);
+    std::string text = make_scan_text(cells);
+
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/tmp/detectssid_bench_%d.txt", (int)getpid());
+    {
+        std::ofstream out(filename);
+        out << text;
+    }
+
+    detectssid::TargetMatcher matcher(kTarget);
+    std::string buffer;
+    std::vector<detectssid::BssRecord> records;
+    std::string network;
+    for(auto _ : state){
+        detectssid::read_scan_file(filename, buffer);
+        detectssid::parse_iwlist_scan(buffer.data(), buffer.size(), records);
+        for(std::size_t i = 0; matcher.search(records, network, i); ++i){
+            benchmark::DoNotOptimize(network.data());
+        }
+    }
+    remove(filename);
+    set_throughput(state, text.size(), cells);
+}
+BENCHMARK(BM_ReadParseMatch)->Arg(10)->Arg(100)->Arg(500)->Arg(2000);
+
+/// one detection cycle without ROS: the read and the detector's DetectionCycle, the robot standing still
+struct Cycle
+{
+    detectssid::IwlistBackend backend;
+    detectssid::TargetMatcher matcher;
+    detectssid::PoseHistory history;
+    detectssid::PropagationMap propagation;
+    detectssid::DetectionCycle cycle;
+    detectssid::DetectionSink sink;
+    double t;
+
+    Cycle(const char* filename, const detectssid::DetectionCycleParams& params)
+        : matcher(kTarget), cycle(params, &history, &propagation, NULL), t(1000.0)
+    {
+        backend.configure(*detectssid::make_scan_config(std::shared_ptr<const detectssid::ScanConfig>(),
+                                                        kTarget, "wlan0", filename, 1.0, 10));
+        cycle.ambient().reset(1000, 0.001);
+        cycle.ambient().insert(0x020000000001ull);
+    }
+
+    void run()
+    {
+        detectssid::PoseSample pose = detectssid::PoseSample();
+        t += 1.0;
+        pose.t = t;
+        pose.qw = 1.0;
+        history.push(pose);
+
+        backend.read(cycle.records());
+        cycle.run(ros::Time(t), matcher, sink);
+    }
+};
+
+
+void BM_SteadyStateCycle(benchmark::State& state)
+{
+    int cells = (int)state.range(0);
+    std::string text = make_scan_text(cells);
+
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/tmp/detectssid_bench_%d.txt", (int)getpid());
+    {
+        std::ofstream out(filename);
+        out << text;
+    }
+
+    // the first cycles size the buffers, the filter slots, the maps and the particles
+    detectssid::DetectionCycleParams params;
+    params.message_pool_size = 8;
+    params.max_networks = cells;
+    Cycle cycle(filename, params);
+    for(int i = 0; i < 3; ++i){
+        cycle.run();
+    }
+
+    uint64_t allocations = 0;
+    for(auto _ : state){
+        uint64_t before = g_allocations.load(std::memory_order_relaxed);
+        cycle.run();
+        allocations += g_allocations.load(std::memory_order_relaxed) - before;
+    }
+    remove(filename);
+
+    set_throughput(state, text.size(), cells);
+    state.counters["allocs/cycle"] = (double)allocations / (double)state.iterations();
+    if(allocations != 0){
+        state.SkipWithError("the steady state cycle allocated");
+    }
+}
+BENCHMARK(BM_SteadyStateCycle)->Arg(10)->Arg(100)->Arg(500)->Arg(2000);
+
+} // namespace
+
+BENCHMARK_MAIN();
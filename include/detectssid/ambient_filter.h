@@ -0,0 +1,73 @@
+/** Ambient access point filter
+ *
+ *  Purpose: remember the BSSIDs that are always present at a site
+ *  (staging area access points, our own mesh nodes) so that they can be
+ *  dropped from every scan before any ssid string matching is done.
+ *
+ *  The set is stored as a Bloom filter: a few kilobytes hold thousands
+ *  of addresses, membership tests never miss a learned address, and a
+ *  new network is wrongly rejected with probability fp_rate.
+ *
+ */
+
+#ifndef DETECTSSID_AMBIENT_FILTER_H
+#define DETECTSSID_AMBIENT_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace detectssid
+{
+
+class AmbientFilter
+{
+public:
+    AmbientFilter();
+
+    /**
+     * @brief Sizes an empty filter
+     *
+     * @param[in] capacity - expected number of distinct ambient BSSIDs
+     * @param[in] fp_rate - acceptable false positive rate, e.g. 0.001
+     */
+    void reset(std::size_t capacity, double fp_rate);
+
+    /**
+     * @brief Records bssid as ambient
+     *
+     * @return true when the filter changed, i.e. bssid was not already known
+     */
+    bool insert(uint64_t bssid);
+
+    /// true when bssid was learned (or, rarely, is a false positive)
+    bool contains(uint64_t bssid) const;
+
+    bool empty() const { return bits_.empty(); }
+    std::size_t count() const { return count_; }
+    std::size_t size_bytes() const { return bits_.size() * sizeof(uint64_t); }
+
+    /**
+     * @brief Writes the filter to filename
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int save(const char* filename) const;
+
+    /**
+     * @brief Replaces the filter with the contents of filename
+     *
+     * @return 0 upon success, -1 upon failure. The filter is unchanged on failure.
+     */
+    int load(const char* filename);
+
+private:
+    std::vector<uint64_t> bits_;
+    uint64_t mask_;         // number of bits - 1, a power of two
+    uint32_t hashes_;
+    std::size_t count_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_AMBIENT_FILTER_H
@@ -0,0 +1,70 @@
+/** Access points from monitor mode frames
+ *
+ *  Purpose: build the same BssRecord table an iwlist scan gives from the
+ *  beacons and probe responses a monitor mode interface captures, with
+ *  their radiotap header.
+ *
+ *  The ssid is escaped as iwlist prints it: non-printable bytes and the
+ *  backslash become \xNN, so the matcher sees the same text either way.
+ *
+ */
+
+#ifndef DETECTSSID_BEACON_FRAME_H
+#define DETECTSSID_BEACON_FRAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "detectssid/bss.h"
+
+namespace detectssid
+{
+
+/**
+ * @brief Parses a beacon or probe response with its radiotap header
+ *
+ * @param[in] data - radiotap header and 802.11 frame
+ * @param[out] bss - bssid, ssid and signal level, last_seen_ms is NaN
+ *
+ * @return false for other frames and malformed ones
+ */
+bool parse_beacon_frame(const uint8_t* data, std::size_t len, BssRecord& bss);
+
+/**
+ * @brief Newest beacon of every access point heard during a scan window
+ */
+class BeaconTable
+{
+public:
+    /**
+     * @brief Adds a captured frame, other frames than beacons are ignored
+     *
+     * @param[in] time_ns - capture time
+     */
+    void add(uint64_t time_ns, const uint8_t* data, std::size_t len);
+
+    /**
+     * @brief Ends the window
+     *
+     * @param[in] scan_done_ns - end of the window, the beacon ages are taken from it
+     * @param[out] records - one record per access point
+     */
+    void take(uint64_t scan_done_ns, std::vector<BssRecord>& records);
+
+    bool empty() const { return beacons_.empty(); }
+
+private:
+    struct Beacon
+    {
+        uint64_t time_ns;
+        BssRecord bss;
+    };
+
+    std::unordered_map<uint64_t, Beacon> beacons_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_BEACON_FRAME_H
@@ -0,0 +1,88 @@
+/** Basic service set (BSS) records parsed from a wireless scan
+ *
+ *  Purpose: turn the text printed by "iwlist [interface] scan" into
+ *  a flat table of access points that the rest of the detector can
+ *  filter and search without re-reading strings.
+ *
+ */
+
+#ifndef DETECTSSID_BSS_H
+#define DETECTSSID_BSS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace detectssid
+{
+
+/// iwlist escapes non-printable ssid bytes as \xNN, 32 bytes can expand to 128
+const std::size_t kMaxSsidText = 128;
+
+/**
+ * @brief One access point seen in a scan
+ *
+ * bssid holds the 48 bit MAC address in the low bits, most significant
+ * octet first, so AA:BB:CC:DD:EE:FF is 0xAABBCCDDEEFF.
+ * ssid holds the ESSID text exactly as printed by iwlist (escaped).
+ * signal_dbm is NaN when the driver did not report a signal level.
+ * last_seen_ms is how long before the end of the scan the last beacon
+ * was received, NaN when the driver did not report it.
+ */
+struct BssRecord
+{
+    uint64_t bssid;
+    float signal_dbm;
+    float last_seen_ms;
+    uint8_t ssid_len;
+    char ssid[kMaxSsidText + 1];
+};
+
+/**
+ * @brief Parses a MAC address of the form AA:BB:CC:DD:EE:FF
+ *
+ * @param[in] text - start of the address, need not be null terminated
+ * @param[in] len - number of characters available at text
+ * @param[out] bssid - parsed address
+ *
+ * @return true when 17 characters forming a valid address were parsed
+ */
+bool parse_bssid(const char* text, std::size_t len, uint64_t& bssid);
+
+/**
+ * @brief Formats a bssid as AA:BB:CC:DD:EE:FF
+ *
+ * @param[in] bssid - 48 bit address
+ * @param[out] out - buffer of at least 18 characters, null terminated
+ */
+void format_bssid(uint64_t bssid, char* out);
+
+/**
+ * @brief Parses the output of "iwlist [interface] scan"
+ *
+ * @param[in] text - scan output, need not be null terminated
+ * @param[in] len - number of characters in text
+ * @param[out] records - cleared, then filled with one entry per cell
+ *
+ * @return number of records parsed
+ *
+ * Only the lines that are needed are looked at, so the output may already
+ * be reduced with grep. A cell starts at each "Address:" line; lines
+ * before the first address are ignored.
+ */
+std::size_t parse_iwlist_scan(const char* text, std::size_t len, std::vector<BssRecord>& records);
+
+/**
+ * @brief Reads an entire file into buffer
+ *
+ * @param[in] filename - file to read
+ * @param[out] buffer - file contents, the allocation is reused between calls
+ *
+ * @return true when the file could be opened
+ */
+bool read_scan_file(const char* filename, std::string& buffer);
+
+} // namespace detectssid
+
+#endif // DETECTSSID_BSS_H
@@ -0,0 +1,32 @@
+/** Little endian fields of the files and datagrams the detector writes
+ */
+
+#ifndef DETECTSSID_BYTE_ORDER_H
+#define DETECTSSID_BYTE_ORDER_H
+
+#include <cstdint>
+
+namespace detectssid
+{
+
+/// stores the low n bytes of v at p, least significant first
+inline void put_le(uint8_t* p, uint64_t v, int n)
+{
+    for(int i = 0; i < n; ++i){
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+/// reads an n byte little endian value at p
+inline uint64_t get_le(const uint8_t* p, int n)
+{
+    uint64_t v = 0;
+    for(int i = 0; i < n; ++i){
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+} // namespace detectssid
+
+#endif // DETECTSSID_BYTE_ORDER_H
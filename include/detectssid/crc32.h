@@ -0,0 +1,18 @@
+/** CRC32 of the files the detector writes
+ */
+
+#ifndef DETECTSSID_CRC32_H
+#define DETECTSSID_CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace detectssid
+{
+
+/// CRC32 (IEEE 802.3, as zlib) of len bytes at data
+uint32_t crc32(const uint8_t* data, std::size_t len);
+
+} // namespace detectssid
+
+#endif // DETECTSSID_CRC32_H
@@ -0,0 +1,262 @@
+/** Detection cycle
+ *
+ *  Purpose: the part of a detector cycle between reading the scan and
+ *  publishing, without a node handle, publisher or ROS log call, so that
+ *  Detector::spin_once() and the allocation test in
+ *  test/test_detection_cycle.cpp run the same code.
+ *
+ *  A run() adds the calibration transmitters to the calibrator, learns or
+ *  rejects the ambient networks, smooths the signal levels and searches
+ *  for the target. Every matching network then gets a detection, tagged
+ *  with the robot pose, and feeds the closest approach detector, the
+ *  heatmap, the observation summary and the localizer. The messages go
+ *  out through a DetectionSink as they are made.
+ *
+ *  Messages come from pools and the buffers are sized at construction;
+ *  once every target has been seen at every place the robot passes, a
+ *  run() does not touch the heap.
+ *
+ */
+
+#ifndef DETECTSSID_DETECTION_CYCLE_H
+#define DETECTSSID_DETECTION_CYCLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>           // shared_ptr
+#include <string>
+#include <vector>
+#include "ros/time.h"
+#include "std_msgs/String.h"
+
+#include "detectssid/ClosestApproach.h"
+#include "detectssid/Detection.h"
+#include "detectssid/PhoneEstimate.h"
+#include "detectssid/ambient_filter.h"
+#include "detectssid/bss.h"
+#include "detectssid/grid_localizer.h"
+#include "detectssid/message_pool.h"
+#include "detectssid/observation_summary.h"
+#include "detectssid/particle_filter.h"
+#include "detectssid/path_loss.h"
+#include "detectssid/peak_detector.h"
+#include "detectssid/pose_history.h"
+#include "detectssid/propagation_map.h"
+#include "detectssid/rssi_filter.h"
+#include "detectssid/rssi_heatmap.h"
+#include "detectssid/scan_config.h"
+#include "detectssid/trace_recorder.h"
+
+namespace detectssid
+{
+
+/**
+ * @brief Removes the records of known ambient networks
+ *
+ * @return number of records removed
+ */
+std::size_t reject_ambient_networks(const AmbientFilter& ambient, std::vector<BssRecord>& records);
+
+/**
+ * @brief Time a scan record was last seen
+ *
+ * @return scan_done less the age of the last beacon
+ */
+ros::Time last_seen_time(const BssRecord& bss, const ros::Time& scan_done);
+
+/**
+ * @brief Fills a detection message for one matching network, tagged with
+ * the robot pose when it was last seen
+ */
+void fill_detection(const BssRecord& bss, const std::string& name,
+                    const ros::Time& scan_done, const std::string& map_frame,
+                    const PoseHistory& pose_history,
+                    const RssiFilterBank& rssi_filter,
+                    Detection& detection);
+
+/**
+ * @brief Fills a phone position estimate message from a localizer estimate
+ */
+void fill_estimate(const Detection& detection,
+                   const PositionEstimate& position,
+                   PhoneEstimate& estimate);
+
+/**
+ * @brief Signal strength map of one target
+ */
+struct TargetHeatmap
+{
+    RssiHeatmap map;
+    double last_time;       // of the newest sample, cached beacons are added once
+};
+
+struct DetectionCycleParams
+{
+    std::string map_frame;
+    std::size_t max_networks;           // records reserved
+    std::size_t message_pool_size;      // detections and estimates, a pool holds two scans
+
+    RssiFilterParams rssi;
+
+    // ambient network baseline, learned instead of rejected with learn_ambient
+    bool learn_ambient;
+
+    // phone localization, "particle" or "grid" localizer per matching bssid
+    bool localize;
+    std::string localizer;
+    ParticleFilterParams particle_filter;
+    GridLocalizerParams grid;
+    PathLossModel path_loss;
+    bool map_aware;
+
+    bool closest_approach;
+    PeakDetectorParams peak;
+
+    bool heatmap;
+    HeatmapParams heatmap_params;
+
+    bool summary;
+    double summary_voxel_size;
+    double summary_z_voxel_size;
+
+    // path loss calibration from transmitters at known positions
+    std::map<uint64_t, PoseSample> calibration_beacons;
+    int calibration_min_samples;
+    double calibration_forgetting;
+
+    DetectionCycleParams()
+        : map_frame("map"), max_networks(512), message_pool_size(64),
+          learn_ambient(false), localize(true), localizer("particle"), map_aware(false),
+          closest_approach(true), heatmap(true), summary(true),
+          summary_voxel_size(2.0), summary_z_voxel_size(0.0),
+          calibration_min_samples(20), calibration_forgetting(0.999)
+    {
+    }
+};
+
+/**
+ * @brief Receives the messages of a DetectionCycle as they are made
+ *
+ * The messages are the pool's, a sink may keep them as long as it likes,
+ * the pool makes a new one in the meantime.
+ */
+class DetectionSink
+{
+public:
+    virtual ~DetectionSink() {}
+
+    /// the target search is done, the detections follow
+    virtual void on_matched() {}
+
+    virtual void on_detection(const DetectionConstPtr&, const BssRecord&) {}
+    virtual void on_closest_approach(const ClosestApproachConstPtr&) {}
+    virtual void on_estimate(const PhoneEstimateConstPtr&) {}
+};
+
+class DetectionCycle
+{
+public:
+    /**
+     * @param[in] params - settings
+     * @param[in] pose_history - robot poses the detections are tagged with
+     * @param[in] propagation - map aware propagation, used with map_aware
+     * @param[in] trace - timeline trace, may be NULL
+     */
+    DetectionCycle(const DetectionCycleParams& params, const PoseHistory* pose_history,
+                   PropagationMap* propagation, TraceRecorder* trace);
+
+    const DetectionCycleParams& params() const { return params_; }
+
+    /// records of the next run(), filled by ScanBackend::read()
+    std::vector<BssRecord>& records() { return records_; }
+
+    /**
+     * @brief Turns the records into messages
+     *
+     * @param[in] scan_done - time the scan completed
+     * @param[in] matcher - target search
+     * @param[in] sink - receives the messages
+     */
+    void run(const ros::Time& scan_done, const TargetMatcher& matcher, DetectionSink& sink);
+
+    /// name of the target network found by the last run(), empty if none
+    const std_msgs::StringPtr& chatter() const { return chatter_; }
+
+    /// detections of the last run()
+    std::vector<DetectionConstPtr>& detections() { return detections_; }
+
+    MessagePool<Detection>& detection_pool() { return detection_pool_; }
+    const RssiFilterBank& rssi_filter() const { return rssi_filter_; }
+
+    /// messages allocated because a pool was exhausted
+    uint64_t pool_misses() const;
+
+    std::map<uint64_t, TargetHeatmap>& heatmaps() { return heatmaps_; }
+    SummaryStore& summary_store() { return summary_store_; }
+    const std::map<uint64_t, std::string>& summary_ssids() const { return summary_ssids_; }
+
+    /**
+     * @brief Loads the calibration and applies it to the path loss model
+     *
+     * @return 0 when a calibration was applied, -1 otherwise
+     */
+    int load_calibration(const char* filename);
+
+    /// @return 0 upon success, -1 upon failure, the samples stay unsaved
+    int save_calibration(const char* filename);
+
+    bool calibration_dirty() const { return calibration_dirty_; }
+    const PathLossModel& path_loss() const { return path_loss_; }
+
+    AmbientFilter& ambient() { return ambient_; }
+
+    /// @return 0 upon success, -1 upon failure, the learned networks stay unsaved
+    int save_ambient(const char* filename);
+
+    bool ambient_dirty() const { return ambient_dirty_; }
+
+private:
+    DetectionCycle(const DetectionCycle&);
+    DetectionCycle& operator=(const DetectionCycle&);
+
+    void process_detection(const BssRecord& bss, const std::string& name,
+                           const ros::Time& scan_done, DetectionSink& sink);
+
+    DetectionCycleParams params_;
+    const PoseHistory* pose_history_;
+    PropagationMap* propagation_;
+    TraceRecorder* trace_;
+
+    std::vector<BssRecord> records_;
+    std::string phone_network_name_;
+    std::string detection_name_;
+    std_msgs::StringPtr chatter_;
+    std::vector<DetectionConstPtr> detections_;
+    MessagePool<std_msgs::String> chatter_pool_;
+    MessagePool<Detection> detection_pool_;
+    MessagePool<PhoneEstimate> estimate_pool_;
+    MessagePool<ClosestApproach> approach_pool_;
+
+    RssiFilterBank rssi_filter_;
+    AmbientFilter ambient_;
+    bool ambient_dirty_;
+
+    std::map<uint64_t, PoseSample> calibration_beacons_;
+    std::map<uint64_t, double> calibration_last_time_;     // of the newest sample per beacon
+    PathLossCalibrator calibrator_;
+    PathLossModel path_loss_;
+    bool calibration_dirty_;
+
+    std::map<uint64_t, std::shared_ptr<Localizer> > localizers_;
+    std::map<uint64_t, PeakDetector> peak_detectors_;
+    std::map<uint64_t, TargetHeatmap> heatmaps_;
+
+    SummaryStore summary_store_;
+    std::map<uint64_t, double> summary_last_time_;
+    std::map<uint64_t, std::string> summary_ssids_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_DETECTION_CYCLE_H
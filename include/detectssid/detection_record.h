@@ -0,0 +1,134 @@
+/** Compact binary detection records
+ *
+ *  Purpose: the link back to the base station may carry only a few
+ *  kbit/s, too little for text reports and per message ROS overhead.
+ *  Detections are packed into fixed layout 20 byte records, batched
+ *  behind a 16 byte header that carries the absolute time; each record
+ *  only stores its time offset from the batch.
+ *
+ *  Batch layout, all fields little endian:
+ *
+ *      offset  size  header
+ *       0      2     magic "DR"
+ *       2      1     version (1)
+ *       3      1     number of records
+ *       4      2     sequence number, wraps around
+ *       6      2     sender id
+ *       8      8     base time, oldest record, ms since the epoch
+ *
+ *      offset  size  record
+ *       0      1     target id, index of the matched target
+ *       1      1     flags, bit 0: pose valid
+ *       2      6     bssid
+ *       8      2     raw rssi, 0.1 dB
+ *      10      2     smoothed rssi, 0.1 dB
+ *      12      6     robot position x, y, z, 0.1 m each
+ *      18      2     time after base time, ms
+ *
+ *  Levels are limited to +-3276 dB and positions to +-3276 m. NaN
+ *  levels are sent as INT16_MIN.
+ *
+ */
+
+#ifndef DETECTSSID_DETECTION_RECORD_H
+#define DETECTSSID_DETECTION_RECORD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace detectssid
+{
+
+const std::size_t kRecordSize = 20;
+const std::size_t kBatchHeaderSize = 16;
+
+/// one decoded detection, in the units of the Detection message
+struct DetectionReport
+{
+    uint8_t target;
+    bool pose_valid;
+    uint64_t bssid;
+    float rssi;             // dBm
+    float rssi_smoothed;    // dBm
+    double x, y, z;         // m
+    double t;               // s since the epoch
+};
+
+class DetectionBatchEncoder
+{
+public:
+    /**
+     * @param[in] sender - sender id written to every batch
+     * @param[in] max_records - records per batch, at most 255
+     */
+    DetectionBatchEncoder(uint16_t sender, std::size_t max_records);
+
+    /**
+     * @brief Appends a detection to the current batch
+     *
+     * The batch base time is its oldest record, the offsets of the records
+     * added before are moved when an older one comes. All records of a
+     * batch must lie within 65.535 s.
+     *
+     * @return false when the batch is full or report does not fit its
+     * time range, the batch is unchanged and should be taken first, and
+     * for a report before the epoch (t < 0), which no batch takes
+     */
+    bool add(const DetectionReport& report);
+
+    /**
+     * @brief Moves the encoded batch into out and starts the next one
+     *
+     * @param[out] out - header and records, empty when there were none
+     */
+    void take(std::vector<uint8_t>& out);
+
+    bool empty() const { return count_ == 0; }
+    std::size_t count() const { return count_; }
+
+private:
+    uint16_t sender_;
+    std::size_t max_records_;
+    uint16_t sequence_;
+    std::size_t count_;
+    uint64_t base_ms_;          // oldest record
+    uint64_t last_ms_;          // newest record
+    std::vector<uint8_t> buffer_;
+};
+
+/**
+ * @brief Packs one record
+ *
+ * @param[in] report - detection, report.t must lie within 65.535 s after base_ms
+ * @param[in] base_ms - time the record offset refers to, ms since the epoch
+ * @param[out] out - kRecordSize bytes
+ */
+void encode_detection_record(const DetectionReport& report, uint64_t base_ms, uint8_t* out);
+
+/**
+ * @brief Unpacks one record
+ *
+ * @param[in] data - kRecordSize bytes
+ * @param[in] base_ms - time the record offset refers to, ms since the epoch
+ * @param[out] report - decoded detection
+ */
+void decode_detection_record(const uint8_t* data, uint64_t base_ms, DetectionReport& report);
+
+/**
+ * @brief Decodes one batch
+ *
+ * @param[in] data - batch as produced by DetectionBatchEncoder::take
+ * @param[in] len - number of bytes at data
+ * @param[out] sender - sender id
+ * @param[out] sequence - batch sequence number
+ * @param[out] reports - decoded detections, replaced
+ *
+ * @return 0 upon success, -1 when data is not a complete batch
+ */
+int decode_detection_batch(const uint8_t* data, std::size_t len, uint16_t& sender, uint16_t& sequence,
+                           std::vector<DetectionReport>& reports);
+
+} // namespace detectssid
+
+#endif // DETECTSSID_DETECTION_RECORD_H
@@ -0,0 +1,370 @@
+/** Phone network detector
+ *
+ *  Purpose: everything the detectssid node does, packaged so that it can
+ *  run either as the standalone detectssid executable or inside a
+ *  nodelet manager (see DetectorNodelet).
+ *
+ *  All messages are published as boost::shared_ptr<const>, so consumers
+ *  in the same nodelet manager receive them without serialization.
+ *  Subscriptions (map, heartbeat) are served from the detector's own
+ *  callback queue by spin_once(), on the thread that runs the scans.
+ *
+ *  The scan_now service is served from its own queue and threads: a
+ *  request waits for the scan in flight, or wakes the scan thread for a
+ *  new one, so any number of concurrent requests cost one scan. A thread
+ *  is added whenever every one is waiting, so no request queues behind
+ *  the others, up to scan_now_max_threads; past that requests wait for a
+ *  free thread. The reconfigure server, the diagnostics and trace timers
+ *  and the wifiDetection connect callback have a queue of their own that
+ *  never blocks. With continuous_scan false the detector only scans on
+ *  request.
+ *
+ *  At startup the results the kernel still holds from earlier scans are
+ *  published first, flagged cached. Only then are the tf listener, the
+ *  map and heartbeat subscriptions, the udp bridge, the forward queue,
+ *  the scan_now threads and the other topics and services set up. A
+ *  subscriber that connects before the first scan completes gets the
+ *  cached detections too.
+ *
+ *  What a cycle does between reading the scan and publishing is a
+ *  DetectionCycle (detection_cycle.h), which the detector feeds and
+ *  publishes from.
+ *
+ *  The target ssid, scan file, loop rate and queue size can be changed
+ *  with dynamic_reconfigure while the detector runs, see scan_config.h.
+ *
+ *  With latency_stats the time spent in each stage of a cycle (scan,
+ *  parse, match, publish) is kept in histograms and published on
+ *  /diagnostics once a second. With trace_file the same stages, and the
+ *  work of the other threads, are written to a timeline trace. With
+ *  perf_counters the CPU cost of the stages is published next to their
+ *  latency.
+ *
+ *  Scans come from a ScanBackend: the wireless interface (wireless_interface,
+ *  or the first wlx* one with an address), a recording of earlier scans,
+ *  beacons captured on a monitor mode interface, or a pcapng file of such
+ *  a capture (scan_backend.h). Every scan can be recorded with record_file,
+ *  and the monitor frames with capture_file. scripts/hwsim_harness runs
+ *  the backends against simulated phones, and the sim backend makes the
+ *  scans up from sim_networks and the robot pose without any radio.
+ *
+ */
+
+#ifndef DETECTSSID_DETECTOR_H
+#define DETECTSSID_DETECTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>           // shared_ptr
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ros/ros.h"
+#include "ros/callback_queue.h"
+#include "diagnostic_updater/diagnostic_updater.h"
+#include "dynamic_reconfigure/server.h"
+#include "map_msgs/OccupancyGridUpdate.h"
+#include "nav_msgs/OccupancyGrid.h"
+#include "std_msgs/Empty.h"
+#include "std_msgs/String.h"
+#include "tf/transform_listener.h"
+
+#include "detectssid/Detection.h"
+#include "detectssid/DetectorConfig.h"
+#include "detectssid/ScanNow.h"
+#include "detectssid/bss.h"
+#include "detectssid/detection_cycle.h"
+#include "detectssid/detection_record.h"
+#include "detectssid/forward_queue.h"
+#include "detectssid/latency_histogram.h"
+#include "detectssid/observation_summary.h"
+#include "detectssid/perf_counters.h"
+#include "detectssid/pose_history.h"
+#include "detectssid/propagation_map.h"
+#include "detectssid/rssi_heatmap.h"
+#include "detectssid/scan_backend.h"
+#include "detectssid/scan_config.h"
+#include "detectssid/scan_recording.h"
+#include "detectssid/trace_recorder.h"
+#include "detectssid/udp_link.h"
+
+namespace detectssid
+{
+
+/**
+ * @brief Reads the first interface name that starts with the letter 'w'
+ *
+ * @param[out] iface_name - contains wireless interface name. Argument is not
+ * changed if the ipAddress cannot be read.
+ *
+ * @return 0 upon succcess, -1 upon failure
+ */
+int get_wireless_interface_name(std::string &iface_name);
+
+/**
+ * @brief Searches a scan file for the phone artifact network ssid
+ *
+ * @return true when phone_artifact_ssid is found in the file ssid_filename
+ */
+bool search_for_phone_ssid(const char* ssid_filename, const char* phone_artifact_ssid, std::string& phone_network);
+
+/**
+ * @brief Searches parsed scan records for phone artifact network ssid
+ *
+ * @param[in] records - access points from the latest scan
+ * @param[in] phone_artifact_ssid - target ssid to be found
+ * @param[out] phone_network - contains name of phone artifact network if found.
+ *                             Otherwise, empty string
+ * @param[in,out] match_index - first record to search, index of the matching
+ *                              record upon return, unchanged if not found
+ *
+ * @return true when phone_artifact_ssid is found in one of the records
+ */
+bool search_bss_records(const std::vector<BssRecord>& records,
+                        const char* phone_artifact_ssid, std::string& phone_network,
+                        std::size_t& match_index);
+
+/**
+ * @brief Scans for available networks into ssid_filename
+ */
+void ssid_network_scan(const char *ifname, const char* ssid_filename);
+
+/**
+ * @brief Samples the robot pose into a PoseHistory
+ *
+ * sample() is run from a timer on its own callback queue and thread, so
+ * poses keep being recorded while the scan thread is blocked in a scan.
+ * Only the newest available transform is read, the lookup never waits.
+ */
+struct PoseSampler
+{
+    tf::TransformListener* listener;
+    PoseHistory* history;
+    std::string map_frame;
+    std::string base_frame;
+
+    void sample(const ros::TimerEvent&);
+};
+
+/**
+ * @brief Feeds the robot occupancy map into a PropagationMap
+ *
+ * Full maps and partial updates are both accepted; callbacks run from
+ * Detector::spin_once(), the same thread as the localizer.
+ */
+struct MapListener
+{
+    PropagationMap* propagation;
+
+    void on_map(const nav_msgs::OccupancyGrid::ConstPtr& map);
+    void on_update(const map_msgs::OccupancyGridUpdate::ConstPtr& update);
+};
+
+/**
+ * @brief Tracks whether the base station is reachable from its heartbeat
+ */
+struct LinkMonitor
+{
+    ros::WallTime last_heartbeat;
+    double timeout;
+
+    void on_heartbeat(const std_msgs::Empty::ConstPtr&);
+    bool up() const;
+};
+
+class Detector : private DetectionSink
+{
+public:
+    /**
+     * @brief Reads the parameters and advertises the topics
+     *
+     * @param[in] n - node handle for topics
+     * @param[in] pn - private node handle for parameters
+     */
+    Detector(const ros::NodeHandle& n, const ros::NodeHandle& pn);
+
+    /// saves the learned ambient networks and calibration
+    ~Detector();
+
+    /**
+     * @brief Opens the scan backend, publishes the cached scan, and starts
+     * taking requests
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int init();
+
+    /// one scan, detection and publish cycle, then serves the callbacks
+    void spin_once();
+
+    /// runs spin_once() at the loop rate, or on request without continuous_scan,
+    /// until ROS shuts down, stop() is called or a replay ends
+    void run();
+
+    /// makes run() return after the current cycle and fails the waiting scan_now
+    /// requests, may be called from any thread
+    void stop();
+
+private:
+    Detector(const Detector&);
+    Detector& operator=(const Detector&);
+
+    void publish_cached_scan();
+    void setup();
+    void advertise_detections(int queue_size);
+    void advertise_outputs();
+    void on_detection_subscriber(const ros::SingleSubscriberPublisher& pub);
+    void on_matched();
+    void on_detection(const DetectionConstPtr& detection, const BssRecord& bss);
+    void send_report(const DetectionReport& report);
+    void on_closest_approach(const ClosestApproachConstPtr& approach);
+    void on_estimate(const PhoneEstimateConstPtr& estimate);
+    void publish_periodic();
+    bool on_scan_now(ScanNow::Request& request, ScanNow::Response& response);
+    void serve_scan_now();
+    void on_reconfigure(DetectorConfig& config, uint32_t level);
+    void apply_config();
+    void mark_stage(int stage, uint64_t& last);
+    void diagnose_latency(diagnostic_updater::DiagnosticStatusWrapper& stat);
+    void diagnose_cost(diagnostic_updater::DiagnosticStatusWrapper& stat);
+    void on_diagnostics_timer(const ros::WallTimerEvent&);
+    void on_trace_timer(const ros::WallTimerEvent&);
+
+    ros::NodeHandle n_;
+    ros::NodeHandle pn_;
+    ros::CallbackQueue queue_;
+    std::atomic<bool> stopped_;
+
+    std::string wifiname_;
+    ros::Publisher chatter_pub_;
+    ros::Publisher detection_pub_;
+    ros::Publisher estimate_pub_;
+    ros::Publisher approach_pub_;
+    ros::Rate loop_rate_;
+
+    // scan settings; config_ is swapped by on_reconfigure() with atomic_store,
+    // active_config_ is the one the scan thread applied last
+    std::shared_ptr<const ScanConfig> config_;
+    std::shared_ptr<const ScanConfig> active_config_;
+    std::unique_ptr<dynamic_reconfigure::Server<DetectorConfig> > reconfigure_server_;
+
+    // per stage latency, latency_ is null when latency_stats is off
+    enum Stage { kScanStage, kParseStage, kMatchStage, kPublishStage, kCycleStage, kStages };
+    std::unique_ptr<LatencyHistogram[]> latency_;
+    bool timed_;                // stage timestamps are taken this cycle
+    uint64_t stage_start_;
+    std::unique_ptr<diagnostic_updater::Updater> diagnostics_;
+    ros::WallTimer diagnostics_timer_;
+
+    // cpu cost of the stages, null when perf_counters is off; the totals of
+    // the previous report give the rates
+    std::unique_ptr<PerfCounters> perf_;
+    uint64_t perf_reported_[kPerfCounters];
+    ros::WallTime perf_reported_time_;
+
+    // timeline trace, null when trace_file is empty
+    std::unique_ptr<TraceRecorder> trace_;
+    ros::WallTimer trace_timer_;
+
+    // on demand scans; scans_started_ counts scans begun, scans_done_ the
+    // completed ones, whose detections are kept in last_detections_
+    bool continuous_scan_;
+    double scan_timeout_;
+    std::mutex scan_mutex_;
+    std::condition_variable scan_cond_;
+    bool scan_requested_;
+    bool scanning_;
+    uint64_t scans_started_;
+    uint64_t scans_done_;
+    ros::Time last_scan_done_;
+    std::vector<DetectionConstPtr> last_detections_;
+    std::vector<DetectionConstPtr> cached_detections_;     // until the first scan completes
+    ros::CallbackQueue service_queue_;
+    std::unique_ptr<ros::AsyncSpinner> service_spinner_;
+
+    // scan_now requests block until their scan, one thread each
+    ros::CallbackQueue scan_now_queue_;
+    ros::ServiceServer scan_now_srv_;
+    std::mutex scan_now_threads_mutex_;
+    std::vector<std::thread> scan_now_threads_;
+    std::size_t scan_now_idle_;         // threads not in a request
+    std::size_t scan_now_max_threads_;  // threads are added up to this many
+    bool scan_now_quit_;
+
+    // per cycle state, sized at startup so a steady cycle does not touch the heap
+    std::unique_ptr<DetectionCycle> cycle_;
+    uint64_t pool_misses_;
+
+    // scan source, opened by init(), and the optional recording of every scan
+    std::string backend_type_;
+    std::string replay_filename_;
+    double replay_speed_;
+    std::string monitor_interface_;
+    std::string pcap_filename_;
+    double scan_window_;
+    std::string capture_prefix_;
+    int capture_size_;
+    int capture_files_;
+    SimulatorParams sim_params_;
+    std::vector<SimulatedNetwork> sim_networks_;
+    std::unique_ptr<ScanBackend> backend_;
+    std::unique_ptr<ScanRecorder> scan_recorder_;
+
+    // robot pose history, sampled from tf on a separate thread
+    PoseSampler pose_sampler_;
+    std::unique_ptr<tf::TransformListener> tf_listener_;
+    std::unique_ptr<PoseHistory> pose_history_;
+    ros::CallbackQueue pose_queue_;
+    ros::Timer pose_timer_;
+    std::unique_ptr<ros::AsyncSpinner> pose_spinner_;
+
+    // optional map aware propagation for the localizer
+    std::unique_ptr<PropagationMap> propagation_;
+    MapListener map_listener_;
+    ros::Subscriber map_sub_, map_update_sub_;
+
+    // signal strength maps, changed tiles published at heatmap_rate, one topic per bssid
+    double heatmap_rate_, heatmap_min_dbm_, heatmap_max_dbm_;
+    std::map<uint64_t, ros::Publisher> heatmap_pubs_;
+    std::vector<const HeatmapTile*> heatmap_tiles_;
+    ros::WallTime heatmap_published_;
+
+    // observation summaries shared with other robots
+    std::string robot_id_;
+    uint64_t summary_incarnation_;      // start time, ns
+    double summary_rate_;
+    int summary_full_every_;
+    ros::Publisher summary_pub_;
+    std::vector<VoxelEntry> summary_entries_;
+    ros::WallTime summary_published_;
+    int summaries_sent_;
+
+    // path loss calibration and ambient network baseline, saved every 10 s while they change
+    std::string calibration_filename_;
+    ros::WallTime calibration_saved_;
+    std::string ambient_filename_;
+    ros::WallTime ambient_saved_;
+
+    // detections for the base station over a plain udp link
+    double bridge_period_;
+    UdpLink bridge_;
+    std::unique_ptr<DetectionBatchEncoder> bridge_encoder_;
+    std::map<uint64_t, double> bridge_last_time_;
+    std::vector<uint8_t> bridge_batch_;
+    ros::WallTime bridge_sent_;
+
+    // store and forward
+    LinkMonitor link_;
+    ForwardQueue forward_queue_;
+    std::unique_ptr<TokenBucket> forward_bucket_;
+    ros::Publisher forward_pub_;
+    ros::Subscriber heartbeat_sub_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_DETECTOR_H
@@ -0,0 +1,156 @@
+/** Persistent store and forward queue of detections
+ *
+ *  Purpose: a robot out of comms range keeps finding phones. Detections
+ *  are kept in a memory mapped file until the link to the base station
+ *  is back, and then forwarded strongest sighting first.
+ *
+ *  The file is an append-only log. Every entry carries a CRC32, so
+ *  after a crash the queue is rebuilt by replaying the entries up to
+ *  the first torn one. A forwarded detection is not removed, an
+ *  acknowledge entry is appended instead. When the file is full, the
+ *  pending detections are copied to a fresh file which replaces it.
+ *
+ *  Only one detection per bssid is pending: the strongest one. A weaker
+ *  sighting of a network that is already queued is dropped.
+ *
+ *  File layout, little endian:
+ *
+ *      header  8     magic "DSSIDFQ1"
+ *              8     reserved
+ *      entry   4     CRC32 of the rest of the entry
+ *              2     payload length
+ *              1     type: 1 detection, 2 acknowledge
+ *              1     reserved
+ *              8     sequence number
+ *              n     payload: detection: time in ms since the epoch,
+ *                    one detection record (see detection_record.h), the
+ *                    length of the network name and the name, at most
+ *                    kMaxSsidText bytes; queues written before names were
+ *                    kept end after the record
+ *                    acknowledge: none, acknowledges sequence number
+ *
+ */
+
+#ifndef DETECTSSID_FORWARD_QUEUE_H
+#define DETECTSSID_FORWARD_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "detectssid/detection_record.h"
+
+namespace detectssid
+{
+
+struct QueuedDetection
+{
+    uint64_t sequence;
+    DetectionReport report;
+    std::string ssid;       // name of the matched network, empty if the entry has none
+};
+
+class ForwardQueue
+{
+public:
+    ForwardQueue();
+    ~ForwardQueue();
+
+    /**
+     * @brief Opens or creates the queue file and replays it
+     *
+     * @param[in] filename - queue file
+     * @param[in] capacity - file size in bytes when the file is created
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int open(const char* filename, std::size_t capacity);
+
+    void close();
+
+    bool is_open() const { return base_ != NULL; }
+
+    /**
+     * @brief Queues a detection
+     *
+     * @param[in] report - detection
+     * @param[in] ssid - name of the matched network, cut to kMaxSsidText bytes
+     *
+     * @return true when it was queued, false when a stronger detection of
+     * the same bssid is pending or the queue could not be written
+     */
+    bool push(const DetectionReport& report, const std::string& ssid);
+
+    /**
+     * @brief The pending detection to forward next, the strongest one
+     *
+     * @return false when nothing is pending
+     */
+    bool front(QueuedDetection& out) const;
+
+    /**
+     * @brief Marks a detection as forwarded
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int acknowledge(uint64_t sequence);
+
+    std::size_t pending() const { return pending_.size(); }
+
+    /// schedules the written entries for writing to disk
+    void sync();
+
+private:
+    ForwardQueue(const ForwardQueue&);
+    ForwardQueue& operator=(const ForwardQueue&);
+
+    typedef std::pair<float, uint64_t> Rank;    // (-priority, sequence)
+
+    int map_file(const char* filename, std::size_t capacity);
+    int append(uint8_t type, uint64_t sequence, const uint8_t* payload, std::size_t len);
+    int compact();
+    void replay();
+    void insert(uint64_t sequence, const DetectionReport& report, const std::string& ssid);
+    void remove(uint64_t sequence);
+
+    std::string filename_;
+    int fd_;
+    uint8_t* base_;
+    std::size_t capacity_;
+    std::size_t end_;           // offset of the next entry
+    uint64_t next_sequence_;
+
+    std::map<uint64_t, QueuedDetection> pending_;   // by sequence
+    std::unordered_map<uint64_t, uint64_t> by_bssid_;
+    std::set<Rank> order_;      // strongest first, then oldest
+};
+
+/**
+ * @brief Token bucket limiting the rate the backlog is drained at
+ */
+class TokenBucket
+{
+public:
+    /**
+     * @param[in] rate - tokens per second
+     * @param[in] burst - bucket size
+     */
+    TokenBucket(double rate, double burst);
+
+    /// takes one token at time now (s), false when none is left
+    bool take(double now);
+
+private:
+    double rate_;
+    double burst_;
+    double tokens_;
+    double last_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_FORWARD_QUEUE_H
@@ -0,0 +1,121 @@
+/** Coarse to fine grid phone localizer
+ *
+ *  Purpose: a deterministic alternative to the particle filter. The
+ *  search area around the first sighting is covered by a coarse grid and
+ *  the path loss likelihood is evaluated at every cell; the best coarse
+ *  cells are refined with a fine grid. The cells lie at the height of the
+ *  first sighting, distances are 3D as in the particle filter.
+ *
+ *  With k = 10 * exponent and L = log10(distance), the squared residual
+ *  sum of a cell is a quadratic in the model parameters:
+ *
+ *      SSE = sum (y + k L - ref_power)^2
+ *
+ *  so each cell only keeps the sums of y, y^2, L, L^2 and y L. A new
+ *  observation adds one term to each cell instead of re-evaluating the
+ *  whole history, and the likelihood can be evaluated for any calibrated
+ *  ref_power and exponent, or with ref_power fitted per cell.
+ *
+ *  A fine block is filled from the stored observation history when its
+ *  coarse cell first enters the top cells, and updated incrementally from
+ *  then on. Every cell then sums the same observations, so likelihoods of
+ *  blocks filled early and late compare. The history can only be replayed
+ *  while it holds every observation and none was made with an effective
+ *  distance field (see PropagationMap), the fields are not kept. After
+ *  max_history observations, or from the first map aware one, no new
+ *  blocks are made: the blocks made so far are kept and updated, and top
+ *  cells without a block are estimated at the coarse resolution. Map
+ *  aware localization is therefore coarse unless refined before the map;
+ *  the detector refuses localizer grid with map_aware.
+ *
+ */
+
+#ifndef DETECTSSID_GRID_LOCALIZER_H
+#define DETECTSSID_GRID_LOCALIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "detectssid/localizer.h"
+
+namespace detectssid
+{
+
+struct GridLocalizerParams
+{
+    double search_radius;       // m, half side of the search square
+    double coarse_resolution;   // m
+    double fine_resolution;     // m
+    std::size_t refine_cells;   // coarse cells refined
+    std::size_t max_history;    // observations kept for filling new fine blocks, refinement stops beyond
+    bool fit_ref_power;         // fit ref_power per cell instead of using the model value
+
+    GridLocalizerParams()
+        : search_radius(60.0), coarse_resolution(2.0), fine_resolution(0.25),
+          refine_cells(4), max_history(20000), fit_ref_power(false)
+    {
+    }
+};
+
+class GridLocalizer : public Localizer
+{
+public:
+    explicit GridLocalizer(const GridLocalizerParams& params);
+
+    /**
+     * The first observation places the search square around the robot.
+     */
+    bool update(const RssiObservation& obs, const PathLossModel& model,
+                const DistanceField* field = NULL);
+
+    /**
+     * Likelihood weighted mean and covariance of the fine cells of the
+     * best coarse cells. The height is the height of the cells.
+     */
+    void estimate(PositionEstimate& out) const;
+
+private:
+    /// sufficient statistics of the residuals of one cell
+    struct CellSums
+    {
+        double y, yy, l, ll, yl;
+    };
+
+    struct FineBlock
+    {
+        uint32_t coarse_index;
+        std::vector<CellSums> cells;
+    };
+
+    void add(CellSums& cell, double y, double l) const;
+    double log_likelihood(const CellSums& cell) const;
+    double log_distance(double cx, double cy, const RssiObservation& obs, const DistanceField* field) const;
+    void refine();
+    void fill_block(FineBlock& block) const;
+    void cell_center(uint32_t coarse_index, uint32_t fine_index, double& x, double& y) const;
+    const FineBlock* find_block(uint32_t coarse_index) const;
+    void stop_refining(const char* reason);
+
+    GridLocalizerParams params_;
+    PathLossModel model_;       // model of the latest update
+    uint32_t coarse_size_;      // coarse cells per side
+    uint32_t fine_per_coarse_;  // fine cells per coarse cell side
+    double origin_x_, origin_y_, origin_z_;     // origin_z_ is the height of every cell
+    double last_time_;
+    std::size_t observations_;
+    double sum_z_, sum_zz_;
+
+    std::vector<CellSums> coarse_;
+    std::vector<FineBlock> blocks_;
+    std::vector<uint32_t> top_;     // coarse indices of the best cells, best first
+    std::vector<RssiObservation> history_;
+    bool replayable_;               // history_ holds every observation, all straight line
+
+    // scratch, reused
+    std::vector<std::pair<double, uint32_t> > ranking_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_GRID_LOCALIZER_H
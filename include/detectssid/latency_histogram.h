@@ -0,0 +1,67 @@
+/** Latency histogram
+ *
+ *  Purpose: the time a detection cycle spends in each stage (scan, parse,
+ *  match, publish), recorded by the scan thread and read by the
+ *  diagnostics thread without a lock.
+ *
+ *  HDR style buckets: values below 64 ns have a bucket each, above that
+ *  every power of two is split into 32 buckets, so percentiles are
+ *  within 3% of the recorded values from nanoseconds to half an hour in
+ *  a fixed 10 kB of counters.
+ *
+ */
+
+#ifndef DETECTSSID_LATENCY_HISTOGRAM_H
+#define DETECTSSID_LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace detectssid
+{
+
+/// CLOCK_MONOTONIC in nanoseconds
+uint64_t monotonic_ns();
+
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    /// records one value in ns, safe to call while another thread reads
+    void record(uint64_t ns);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Value at or below which the fraction q of the values lie
+     *
+     * @param[in] q - 0 to 1
+     *
+     * @return upper bound of the bucket holding the value, in ns, 0 when empty
+     */
+    uint64_t percentile(double q) const;
+
+    static const int kLinearBuckets = 64;
+    static const int kSubBuckets = 32;
+    static const int kMaxExponent = 40;     // values from 2^41 ns (~37 min) on share the last bucket
+    static const int kBuckets = kLinearBuckets + (kMaxExponent - 5) * kSubBuckets;
+
+private:
+    LatencyHistogram(const LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+
+    static int bucket(uint64_t ns);
+    static uint64_t bucket_end(int index);
+
+    std::atomic<uint64_t> counts_[kBuckets];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> max_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_LATENCY_HISTOGRAM_H
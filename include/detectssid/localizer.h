@@ -0,0 +1,59 @@
+/** Phone position estimator interface
+ *
+ *  Purpose: the node keeps one estimator per target network and feeds it
+ *  pose-tagged signal levels. ParticleFilter and GridLocalizer implement
+ *  this interface, ~localizer selects one of them.
+ *
+ */
+
+#ifndef DETECTSSID_LOCALIZER_H
+#define DETECTSSID_LOCALIZER_H
+
+#include <cstddef>
+
+#include "detectssid/path_loss.h"
+#include "detectssid/propagation_map.h"
+
+namespace detectssid
+{
+
+/// a signal level measured at a robot position
+struct RssiObservation
+{
+    double t;               // s
+    double x, y, z;         // robot position, m
+    double rssi;            // dBm
+};
+
+struct PositionEstimate
+{
+    double x, y, z;
+    double cov[9];          // row major 3x3 covariance, m^2
+    std::size_t observations;
+};
+
+class Localizer
+{
+public:
+    virtual ~Localizer() {}
+
+    /**
+     * @brief Applies one observation
+     *
+     * @param[in] field - optional effective distance field from the robot
+     *                    position, see PropagationMap. Without it, or outside
+     *                    its window, the straight line distance is used.
+     *
+     * @return false when obs is not newer than the last observation applied;
+     * a scan can report the same cached beacon again, it is not counted twice.
+     */
+    virtual bool update(const RssiObservation& obs, const PathLossModel& model,
+                        const DistanceField* field = NULL) = 0;
+
+    /// current position estimate and its covariance
+    virtual void estimate(PositionEstimate& out) const = 0;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_LOCALIZER_H
@@ -0,0 +1,75 @@
+/** Pool of reusable ROS messages
+ *
+ *  Purpose: keep the heap out of the detection cycle. Messages are
+ *  published as shared pointers, so a subscriber in the same process, a
+ *  publisher queue or a scan_now request may still hold one after the
+ *  cycle. The pool hands out a message only when it is the sole holder,
+ *  with the fields of its last use: strings and arrays keep their
+ *  capacity, and the caller overwrites every field.
+ *
+ *  When every pooled message is still held, get() falls back to a new
+ *  message and counts a miss; a pool sized at startup for the messages
+ *  in flight never misses.
+ *
+ */
+
+#ifndef DETECTSSID_MESSAGE_POOL_H
+#define DETECTSSID_MESSAGE_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace detectssid
+{
+
+template<class M>
+class MessagePool
+{
+public:
+    /// @param[in] size - messages made up front
+    explicit MessagePool(std::size_t size = 0)
+        : misses_(0)
+    {
+        reserve(size);
+    }
+
+    /// grows the pool to size messages, call before the first cycle
+    void reserve(std::size_t size)
+    {
+        pool_.reserve(size);
+        while(pool_.size() < size){
+            pool_.push_back(typename M::Ptr(new M));
+        }
+    }
+
+    /**
+     * @brief The first message no one else holds
+     *
+     * The same few messages keep coming back, their strings grown to size
+     * and warm in the cache. Only one thread may call get().
+     */
+    typename M::Ptr get()
+    {
+        for(std::size_t i = 0; i < pool_.size(); ++i){
+            if(pool_[i].use_count() == 1){
+                return pool_[i];
+            }
+        }
+        ++misses_;
+        return typename M::Ptr(new M);
+    }
+
+    std::size_t size() const { return pool_.size(); }
+
+    /// messages allocated because the pool was exhausted
+    uint64_t misses() const { return misses_; }
+
+private:
+    std::vector<typename M::Ptr> pool_;
+    uint64_t misses_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_MESSAGE_POOL_H
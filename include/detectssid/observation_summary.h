@@ -0,0 +1,153 @@
+/** Mergeable observation summaries
+ *
+ *  Purpose: several robots see the same phone from different places.
+ *  Instead of sending raw scans over the mesh, each robot summarizes
+ *  its samples per target and voxel as sufficient statistics (count,
+ *  sum, sum of squares, max), from which mean and variance follow.
+ *
+ *  The statistics a robot holds for a voxel only grow, so a newer copy
+ *  always has a larger count. Replicas of one robot are merged by keeping
+ *  the copy with the larger count, which is idempotent, commutative and
+ *  associative (a state based CRDT): summaries can be resent, reordered
+ *  or relayed without being counted twice. Totals across robots are the
+ *  sums of each robot's copy.
+ *
+ *  A restarted detector starts counting from 0 again. Each run carries
+ *  its own incarnation (its start time), and the runs of a robot are
+ *  merged as separate replicas and summed like different robots.
+ *
+ */
+
+#ifndef DETECTSSID_OBSERVATION_SUMMARY_H
+#define DETECTSSID_OBSERVATION_SUMMARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace detectssid
+{
+
+struct VoxelKey
+{
+    uint64_t target;        // bssid
+    int32_t x, y, z;        // voxel index
+
+    bool operator==(const VoxelKey& other) const
+    {
+        return target == other.target && x == other.x && y == other.y && z == other.z;
+    }
+};
+
+struct VoxelKeyHash
+{
+    std::size_t operator()(const VoxelKey& key) const
+    {
+        uint64_t h = key.target * 0x9e3779b97f4a7c15ULL;
+        h ^= ((uint64_t)(uint32_t)key.x * 0xbf58476d1ce4e5b9ULL) + (h << 6) + (h >> 2);
+        h ^= ((uint64_t)(uint32_t)key.y * 0x94d049bb133111ebULL) + (h << 6) + (h >> 2);
+        h ^= ((uint64_t)(uint32_t)key.z) + (h << 6) + (h >> 2);
+        return (std::size_t)h;
+    }
+};
+
+struct VoxelStatistics
+{
+    uint32_t count;
+    double sum;             // dBm
+    double sum_sq;          // dBm^2
+    float max;              // dBm
+
+    VoxelStatistics();
+
+    void add(float rssi);
+
+    /// replica merge of one robot's copies: keeps the copy with the larger count
+    bool merge(const VoxelStatistics& other);
+
+    /// combines the statistics of two different robots
+    void accumulate(const VoxelStatistics& other);
+};
+
+typedef std::pair<VoxelKey, VoxelStatistics> VoxelEntry;
+
+/**
+ * @brief Statistics of one robot, per target and voxel
+ */
+class SummaryStore
+{
+public:
+    explicit SummaryStore(double voxel_size = 1.0, double z_voxel_size = 0.0);
+
+    /// adds a local sample of target measured at (x, y, z)
+    void add(uint64_t target, double x, double y, double z, float rssi);
+
+    /**
+     * @brief Merges a copy received from a replica of this robot
+     *
+     * @return true when the stored statistics changed
+     */
+    bool merge(const VoxelKey& key, const VoxelStatistics& stats);
+
+    /**
+     * @brief Collects the voxels changed since the last call
+     *
+     * @param[in] full - collect every voxel, for periodic anti-entropy resends
+     * @param[out] entries - changed voxels
+     */
+    void take_changes(bool full, std::vector<VoxelEntry>& entries);
+
+    double voxel_size() const { return voxel_size_; }
+    double z_voxel_size() const { return z_voxel_size_; }
+    std::size_t size() const { return voxels_.size(); }
+
+    typedef std::unordered_map<VoxelKey, std::pair<VoxelStatistics, bool>, VoxelKeyHash> Map;
+    const Map& voxels() const { return voxels_; }
+
+private:
+    double voxel_size_;
+    double z_voxel_size_;
+    Map voxels_;            // statistics and changed flag
+    std::vector<VoxelKey> changed_;
+};
+
+/**
+ * @brief Merged view of the summaries of several robots
+ */
+class SummaryAggregator
+{
+public:
+    /**
+     * @brief Merges one voxel received from robot
+     *
+     * @param[in] incarnation - run of the robot's detector, see ObservationSummary
+     *
+     * @return true when the merged view changed
+     */
+    bool merge(const std::string& robot, uint64_t incarnation, const VoxelKey& key, const VoxelStatistics& stats);
+
+    /**
+     * @brief Statistics of all robots combined, per target and voxel
+     *
+     * @param[out] totals - voxels, in no particular order
+     */
+    void totals(std::vector<VoxelEntry>& totals) const;
+
+    /// robots merged, each counted once over its runs
+    std::size_t robots() const;
+
+    /// runs merged, over all robots
+    std::size_t replicas() const { return replicas_.size(); }
+
+private:
+    typedef std::pair<std::string, uint64_t> Replica;   // robot, incarnation
+    std::map<Replica, SummaryStore> replicas_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_OBSERVATION_SUMMARY_H
@@ -0,0 +1,84 @@
+/** Phone position particle filter
+ *
+ *  Purpose: estimate where a phone is from signal levels measured at
+ *  known robot positions. Each particle is a candidate phone position;
+ *  an observation reweights every particle by how well the path loss
+ *  model explains the measured level at that distance.
+ *
+ *  The phone does not move, so there is no motion model. After each
+ *  resampling the particles are jittered slightly (roughening) to keep
+ *  diversity. The weight update runs in parallel with OpenMP when the
+ *  package is built with it.
+ *
+ */
+
+#ifndef DETECTSSID_PARTICLE_FILTER_H
+#define DETECTSSID_PARTICLE_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "detectssid/localizer.h"
+
+namespace detectssid
+{
+
+struct ParticleFilterParams
+{
+    std::size_t particles;
+    double init_radius;     // m, horizontal spread around the first observation
+    double init_height;     // m, vertical spread around the first observation
+    double roughening;      // m, jitter added after resampling, none when 0
+
+    ParticleFilterParams()
+        : particles(2000), init_radius(40.0), init_height(2.0), roughening(0.2)
+    {
+    }
+};
+
+class ParticleFilter : public Localizer
+{
+public:
+    ParticleFilter(const ParticleFilterParams& params, uint32_t seed = 1);
+
+    /**
+     * @brief Applies one observation
+     *
+     * The first observation seeds the particles uniformly in a cylinder of
+     * init_radius and init_height around the robot.
+     */
+    bool update(const RssiObservation& obs, const PathLossModel& model,
+                const DistanceField* field = NULL);
+
+    /// weighted mean and covariance of the particles
+    void estimate(PositionEstimate& out) const;
+
+    bool initialized() const { return !x_.empty(); }
+
+    /// effective sample size, 1 / sum w^2
+    double effective_size() const;
+
+private:
+    void seed(const RssiObservation& obs);
+    void normalize(double max_log_weight);
+    void resample();
+
+    ParticleFilterParams params_;
+    std::mt19937 rng_;
+    std::size_t observations_;
+    double last_time_;
+
+    // structure of arrays, one entry per particle
+    std::vector<double> x_, y_, z_;
+    std::vector<double> log_w_;
+    std::vector<double> w_;
+
+    // resampling scratch, reused
+    std::vector<double> rx_, ry_, rz_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_PARTICLE_FILTER_H
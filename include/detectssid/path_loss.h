@@ -0,0 +1,108 @@
+/** Log-distance path loss model
+ *
+ *  Expected signal level at distance d from a transmitter:
+ *
+ *      rssi(d) = ref_power - 10 * exponent * log10(d / 1 m)
+ *
+ *  ref_power is the level at 1 m and exponent is 2 in free space, more
+ *  in cluttered or tunnel environments. Samples scatter around rssi(d)
+ *  with standard deviation sigma (shadowing).
+ *
+ *  PathLossCalibrator refits ref_power and exponent online from samples
+ *  of transmitters at known positions (e.g. our own mesh nodes). The model
+ *  is linear in (ref_power, exponent) with regressor (1, -10 log10 d), so
+ *  recursive least squares updates a 2x2 covariance in constant time.
+ *
+ */
+
+#ifndef DETECTSSID_PATH_LOSS_H
+#define DETECTSSID_PATH_LOSS_H
+
+#include <cmath>
+#include <cstddef>
+
+namespace detectssid
+{
+
+struct PathLossModel
+{
+    double ref_power;       // dBm at 1 m
+    double exponent;
+    double sigma;           // dB
+    double min_distance;    // m, distances below are clamped, the model breaks down near field
+
+    PathLossModel()
+        : ref_power(-40.0), exponent(2.5), sigma(6.0), min_distance(0.5)
+    {
+    }
+
+    double expected_rssi(double distance) const
+    {
+        if(distance < min_distance){
+            distance = min_distance;
+        }
+        return ref_power - 10.0 * exponent * std::log10(distance);
+    }
+};
+
+class PathLossCalibrator
+{
+public:
+    /**
+     * @param[in] forgetting - RLS forgetting factor in (0, 1], below 1 lets
+     *                         the fit follow a changing environment
+     */
+    explicit PathLossCalibrator(double forgetting = 0.999);
+
+    /**
+     * @brief Starts from prior, with an uncertainty that any real data overrides
+     */
+    void reset(const PathLossModel& prior);
+
+    /**
+     * @brief Adds one sample of a transmitter at known distance
+     *
+     * @param[in] distance - transmitter to receiver distance, m
+     * @param[in] rssi - measured level, dBm
+     */
+    void add(double distance, double rssi);
+
+    /**
+     * @brief Copies the fitted parameters into model
+     *
+     * Nothing is copied until min_samples samples with enough spread in
+     * distance have been seen, a fit from one range is not identifiable.
+     * sigma is replaced by the running residual standard deviation.
+     *
+     * @return true when model was updated
+     */
+    bool apply(PathLossModel& model, std::size_t min_samples = 20) const;
+
+    std::size_t samples() const { return samples_; }
+
+    /**
+     * @brief Writes the calibration state to filename
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int save(const char* filename) const;
+
+    /**
+     * @brief Restores the calibration state saved by save()
+     *
+     * @return 0 upon success, -1 upon failure, the state is unchanged on failure
+     */
+    int load(const char* filename);
+
+private:
+    double lambda_;
+    double theta_[2];       // ref_power, exponent
+    double p_[3];           // symmetric covariance, p00 p01 p11
+    double residual_var_;   // running mean of squared prior residuals, dB^2, exponentially weighted for lambda < 1
+    double min_log_d_, max_log_d_;
+    std::size_t samples_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_PATH_LOSS_H
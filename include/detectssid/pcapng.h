@@ -0,0 +1,136 @@
+/** pcapng capture files of monitor mode frames
+ *
+ *  Purpose: keep the raw 802.11 frames a monitor mode capture saw, and
+ *  run the detector on them later without a radio.
+ *
+ *  PcapngWriter writes one interface of link type radiotap, timestamps
+ *  in ns, one enhanced packet block per frame. A frame is written with
+ *  writev() straight from where it is, e.g. the capture ring, no copy.
+ *  Files are rotated at max_file_bytes and only the newest max_files are
+ *  kept, so a capture never takes more than their product on disk. A
+ *  restarted capture continues the numbering of the files it finds and
+ *  counts them against max_files.
+ *
+ *  PcapngReader maps a file and returns its frames in order. Only little
+ *  endian sections are read, e.g. those written by this writer, Wireshark
+ *  or dumpcap on a PC or a robot.
+ *
+ */
+
+#ifndef DETECTSSID_PCAPNG_H
+#define DETECTSSID_PCAPNG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace detectssid
+{
+
+/// LINKTYPE_IEEE802_11_RADIOTAP
+const uint16_t kLinkTypeRadiotap = 127;
+
+class PcapngWriter
+{
+public:
+    PcapngWriter();
+    ~PcapngWriter();
+
+    /**
+     * @brief Starts writing prefix-N.pcapng
+     *
+     * N is 0, or one more than the newest prefix-N.pcapng already there;
+     * the older files beyond max_files are removed.
+     *
+     * @param[in] prefix - path and start of the file names
+     * @param[in] max_file_bytes - a file is closed once it reaches this size
+     * @param[in] max_files - number of files kept, older ones are removed
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int open(const char* prefix, std::size_t max_file_bytes, int max_files);
+
+    void close();
+
+    bool is_open() const { return fd_ >= 0; }
+
+    /**
+     * @brief Writes one frame
+     *
+     * @param[in] time_ns - capture time, ns since the epoch
+     * @param[in] data - radiotap header and 802.11 frame
+     * @param[in] len - captured bytes
+     * @param[in] orig_len - length of the frame on the air
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int write(uint64_t time_ns, const uint8_t* data, uint32_t len, uint32_t orig_len);
+
+private:
+    PcapngWriter(const PcapngWriter&);
+    PcapngWriter& operator=(const PcapngWriter&);
+
+    int start_file();
+    std::string file_name(long index) const;
+    long resume();
+
+    std::string prefix_;
+    std::size_t max_file_bytes_;
+    int max_files_;
+    long index_;                // number of the current file
+    int fd_;
+    std::size_t size_;          // bytes in the current file
+};
+
+/**
+ * @brief One frame of a capture file, pointing into the mapped file
+ */
+struct PcapngPacket
+{
+    uint64_t time_ns;
+    uint16_t link_type;
+    const uint8_t* data;
+    uint32_t len;
+};
+
+class PcapngReader
+{
+public:
+    PcapngReader();
+    ~PcapngReader();
+
+    /// @return 0 upon success, -1 upon failure
+    int open(const char* filename);
+
+    void close();
+
+    /**
+     * @brief Reads the next frame
+     *
+     * @return false at the end of the file or at a malformed block
+     */
+    bool next(PcapngPacket& packet);
+
+private:
+    PcapngReader(const PcapngReader&);
+    PcapngReader& operator=(const PcapngReader&);
+
+    struct Interface
+    {
+        uint16_t link_type;
+        bool binary;            // resolution is 2^-exponent seconds, else 10^-exponent
+        uint8_t exponent;
+    };
+
+    void add_interface(const uint8_t* body, std::size_t len);
+
+    const uint8_t* base_;
+    std::size_t size_;
+    std::size_t offset_;
+    std::vector<Interface> interfaces_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_PCAPNG_H
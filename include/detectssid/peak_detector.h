@@ -0,0 +1,71 @@
+/** Closest approach detector
+ *
+ *  Purpose: a cheap first estimate of where a phone is, without a
+ *  localizer. As the robot drives past a phone the smoothed signal level
+ *  rises to a maximum and falls off again; the robot pose at that maximum
+ *  is where it passed closest to the phone.
+ *
+ *  Peaks are found with hysteresis: a maximum is reported once the level
+ *  has fallen drop_db below it, and the next one can only be reported
+ *  after the level has risen drop_db above the following minimum. This
+ *  keeps constant state per target and ignores ripples smaller than drop_db.
+ *
+ */
+
+#ifndef DETECTSSID_PEAK_DETECTOR_H
+#define DETECTSSID_PEAK_DETECTOR_H
+
+#include "detectssid/pose_history.h"
+
+namespace detectssid
+{
+
+struct PeakDetectorParams
+{
+    float threshold_dbm;    // peaks below this level are not reported
+    float drop_db;          // hysteresis
+    float max_stddev_db;    // samples with a larger filter standard deviation are skipped
+
+    PeakDetectorParams()
+        : threshold_dbm(-75.0f), drop_db(6.0f), max_stddev_db(4.0f)
+    {
+    }
+};
+
+struct PeakEvent
+{
+    PoseSample pose;        // robot pose at the peak, pose.t is the peak time
+    float rssi;             // smoothed level at the peak, dBm
+    float prominence;       // dB the level fell below the peak before it was reported
+};
+
+class PeakDetector
+{
+public:
+    explicit PeakDetector(const PeakDetectorParams& params = PeakDetectorParams());
+
+    void set_params(const PeakDetectorParams& params) { params_ = params; }
+
+    /**
+     * @brief Adds one smoothed sample
+     *
+     * @param[in] pose - robot pose when the sample was taken, pose.t is its time
+     * @param[in] rssi - smoothed level, dBm
+     * @param[in] variance - variance of rssi, dB^2
+     * @param[out] event - filled when a peak is reported
+     *
+     * @return true when a peak was reported
+     */
+    bool add(const PoseSample& pose, float rssi, float variance, PeakEvent& event);
+
+private:
+    PeakDetectorParams params_;
+    bool seeking_peak_;
+    float extreme_;         // running maximum while seeking a peak, else running minimum
+    PoseSample extreme_pose_;
+    double last_time_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_PEAK_DETECTOR_H
@@ -0,0 +1,84 @@
+/** CPU cost of the detection pipeline stages
+ *
+ *  Purpose: the robot's compute board is CPU bound, and a scan forks
+ *  iwlist every cycle and filters its output. Kernel performance counters,
+ *  opened with perf_event_open, measure what each stage really costs:
+ *  CPU time, instructions, context switches and page faults.
+ *
+ *  The counters follow the scan thread and, inherited, the processes it
+ *  starts, so the scan stage includes the cost of the scan command. A
+ *  counter the kernel does not provide (e.g. instructions in a virtual
+ *  machine, or with perf_event_paranoid too high) is left out, the others
+ *  are still counted.
+ *
+ *  mark() is called by the scan thread, the totals are read by the
+ *  diagnostics thread without a lock.
+ *
+ */
+
+#ifndef DETECTSSID_PERF_COUNTERS_H
+#define DETECTSSID_PERF_COUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>           // unique_ptr
+
+namespace detectssid
+{
+
+enum PerfCounter
+{
+    kTaskClock,             // ns of CPU time
+    kInstructions,
+    kContextSwitches,
+    kPageFaults,
+    kPerfCounters
+};
+
+class PerfCounters
+{
+public:
+    /// @param[in] stages - number of stages counted
+    explicit PerfCounters(int stages);
+    ~PerfCounters();
+
+    /**
+     * @brief Opens the counters for the calling thread and its children
+     *
+     * @return 0 when at least one counter is available, -1 otherwise
+     */
+    int open();
+
+    bool available(int counter) const { return fd_[counter] >= 0; }
+
+    /// starts a cycle, the next mark() counts from here
+    void start();
+
+    /// adds the counts since the previous start() or mark() to stage
+    void mark(int stage);
+
+    /// sum over all marks of stage, 0 for an unavailable counter
+    uint64_t total(int stage, int counter) const;
+
+    /// number of marks of stage
+    uint64_t samples(int stage) const;
+
+    /// short name of a counter for reports
+    static const char* name(int counter);
+
+private:
+    PerfCounters(const PerfCounters&);
+    PerfCounters& operator=(const PerfCounters&);
+
+    void read(uint64_t values[kPerfCounters]) const;
+
+    int stages_;
+    int fd_[kPerfCounters];
+    uint64_t last_[kPerfCounters];
+    std::unique_ptr<std::atomic<uint64_t>[]> totals_;      // stages_ x kPerfCounters
+    std::unique_ptr<std::atomic<uint64_t>[]> samples_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_PERF_COUNTERS_H
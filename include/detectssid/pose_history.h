@@ -0,0 +1,77 @@
+/** Robot pose history
+ *
+ *  Purpose: a network is seen when its beacon arrives, which can be
+ *  seconds before the scan that reports it finishes. To tag a sighting
+ *  with the pose of the robot at that moment, recent poses are kept in
+ *  a fixed size ring buffer and interpolated at the sighting time.
+ *
+ *  Times are in seconds on any monotonic clock shared by producer and
+ *  consumer (ros::Time::toSec() in the node). Poses are appended in time
+ *  order by one thread and read by another, a mutex keeps them consistent.
+ *
+ */
+
+#ifndef DETECTSSID_POSE_HISTORY_H
+#define DETECTSSID_POSE_HISTORY_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace detectssid
+{
+
+struct PoseSample
+{
+    double t;
+    double x, y, z;
+    double qx, qy, qz, qw;
+};
+
+class PoseHistory
+{
+public:
+    /**
+     * @param[in] capacity - number of poses kept
+     * @param[in] max_gap - largest gap between two poses, seconds, that is
+     *                      interpolated across
+     */
+    explicit PoseHistory(std::size_t capacity = 512, double max_gap = 0.5);
+
+    /**
+     * @brief Appends a pose
+     *
+     * Poses that are not newer than the last one are ignored.
+     */
+    void push(const PoseSample& pose);
+
+    /**
+     * @brief Interpolates the pose at time t
+     *
+     * @param[in] t - query time, seconds
+     * @param[out] pose - position interpolated linearly, orientation by slerp
+     *
+     * @return true when t lies between two stored poses no more than
+     * max_gap apart, or within max_gap of the newest pose (the newest pose
+     * is then returned). Otherwise false and pose is unchanged.
+     */
+    bool lookup(double t, PoseSample& pose) const;
+
+    /// time of the newest pose, 0 when empty
+    double newest() const;
+
+    std::size_t size() const;
+
+private:
+    const PoseSample& at(std::size_t i) const { return ring_[(head_ + i) % ring_.size()]; }
+
+    mutable std::mutex mutex_;
+    std::vector<PoseSample> ring_;
+    std::size_t head_;      // index of the oldest pose
+    std::size_t count_;
+    double max_gap_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_POSE_HISTORY_H
@@ -0,0 +1,138 @@
+/** Map aware signal propagation distance
+ *
+ *  Purpose: in a tunnel the signal of a phone around a bend reaches the
+ *  robot along the tunnel, or through rock with heavy loss, not along a
+ *  straight line. Using the straight line distance in the path loss model
+ *  puts the phone estimate on the wrong side of the bend.
+ *
+ *  The robot occupancy map is reduced to a coarse obstacle grid. For a
+ *  robot position an effective distance field is computed with Dijkstra:
+ *  stepping through a free or unknown cell costs its length, stepping
+ *  into an occupied cell costs its length plus wall_penalty meters. The
+ *  path loss model is then evaluated at the effective distance, which is
+ *  a single array lookup per particle.
+ *
+ *  Fields are computed only within max_range of the robot and cached per
+ *  robot cell. Map updates adjust the coarse grid cell by cell and only
+ *  drop the cached fields whose window they touch.
+ *
+ */
+
+#ifndef DETECTSSID_PROPAGATION_MAP_H
+#define DETECTSSID_PROPAGATION_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+namespace detectssid
+{
+
+struct PropagationParams
+{
+    double resolution;      // m, coarse grid cell side
+    double max_range;       // m, field radius
+    double wall_penalty;    // m, extra cost of entering an occupied coarse cell
+    int occupied_threshold; // map values at or above are walls
+    std::size_t cache_size; // number of fields kept
+
+    PropagationParams()
+        : resolution(0.5), max_range(60.0), wall_penalty(10.0), occupied_threshold(65), cache_size(16)
+    {
+    }
+};
+
+/**
+ * @brief Effective distance from one source cell, on a square window
+ */
+class DistanceField
+{
+public:
+    /**
+     * @brief Effective distance from the source to (x, y), m
+     *
+     * @return max_range when (x, y) is not reachable within max_range, a
+     * negative value when (x, y) is outside the window; the caller then
+     * falls back to the straight line distance.
+     */
+    double distance(double x, double y) const
+    {
+        int32_t cx = (int32_t)((x - origin_x_) * inv_resolution_);
+        int32_t cy = (int32_t)((y - origin_y_) * inv_resolution_);
+        if(x < origin_x_ || y < origin_y_ || cx >= size_ || cy >= size_){
+            return -1.0;
+        }
+        return dist_[(std::size_t)cy * size_ + cx];
+    }
+
+private:
+    friend class PropagationMap;
+
+    int32_t source_cx_, source_cy_;     // coarse cell of the source
+    int32_t window_x_, window_y_;       // coarse cell of the window corner
+    int32_t size_;                      // window side, coarse cells
+    double origin_x_, origin_y_;        // window corner, m
+    double inv_resolution_;
+    std::vector<float> dist_;
+};
+
+class PropagationMap
+{
+public:
+    explicit PropagationMap(const PropagationParams& params = PropagationParams());
+
+    /**
+     * @brief Replaces the map
+     *
+     * @param[in] data - row major occupancy, -1 unknown, 0..100 probability
+     *
+     * When the size, resolution and origin are unchanged only the cells
+     * that differ are applied, as by update_region().
+     */
+    void set_map(const int8_t* data, uint32_t width, uint32_t height,
+                 double resolution, double origin_x, double origin_y);
+
+    /**
+     * @brief Applies a partial map update
+     *
+     * @param[in] data - row major occupancy of the region
+     * @param[in] x, y - map cell of the region corner
+     * @param[in] width, height - region size, map cells
+     */
+    void update_region(const int8_t* data, int32_t x, int32_t y, uint32_t width, uint32_t height);
+
+    bool has_map() const { return !cells_.empty(); }
+
+    /**
+     * @brief Effective distance field from (x, y)
+     *
+     * @return NULL when there is no map or (x, y) is outside it. The field
+     * stays valid until the next call to any non-const method.
+     */
+    const DistanceField* field(double x, double y);
+
+private:
+    void compute(DistanceField& field) const;
+    void invalidate(int32_t cx0, int32_t cy0, int32_t cx1, int32_t cy1);
+
+    PropagationParams params_;
+
+    // fine map as received
+    std::vector<int8_t> cells_;
+    uint32_t width_, height_;
+    double map_resolution_;
+    double origin_x_, origin_y_;
+
+    // coarse grid: number of occupied map cells within each coarse cell
+    std::vector<uint16_t> walls_;
+    int32_t coarse_width_, coarse_height_;
+    int32_t ratio_;     // map cells per coarse cell side
+
+    // most recently used field first
+    std::list<DistanceField> cache_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_PROPAGATION_MAP_H
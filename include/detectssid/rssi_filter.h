@@ -0,0 +1,96 @@
+/** Per access point signal level smoothing
+ *
+ *  Purpose: raw RSSI samples jump by several dB from scan to scan.
+ *  Each BSS gets an exponential moving average and a one dimensional
+ *  Kalman filter (random walk model) of its signal level.
+ *
+ *  The filter state is kept as a structure of arrays, one slot per BSS,
+ *  so that a scan is applied in a single branch free sweep that the
+ *  compiler can vectorize: the scan only stages measurements, update()
+ *  then advances every slot at once.
+ *
+ */
+
+#ifndef DETECTSSID_RSSI_FILTER_H
+#define DETECTSSID_RSSI_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace detectssid
+{
+
+struct RssiFilterParams
+{
+    float ema_alpha;            // weight of a new sample in the moving average
+    float process_noise;        // Kalman random walk variance per scan, dB^2
+    float measurement_noise;    // Kalman measurement variance, dB^2
+    uint32_t max_age;           // scans without a sample before a slot is dropped
+
+    RssiFilterParams()
+        : ema_alpha(0.3f), process_noise(1.0f), measurement_noise(36.0f), max_age(200)
+    {
+    }
+};
+
+struct RssiEstimate
+{
+    float raw;                  // last sample, dBm
+    float ema;                  // exponential moving average, dBm
+    float smoothed;             // Kalman estimate, dBm
+    float variance;             // Kalman estimate variance, dB^2
+};
+
+class RssiFilterBank
+{
+public:
+    explicit RssiFilterBank(const RssiFilterParams& params = RssiFilterParams());
+
+    void set_params(const RssiFilterParams& params) { params_ = params; }
+
+    /**
+     * @brief Stages one sample for the next update()
+     *
+     * A BSS that has not been seen before is given a new slot initialized
+     * to the sample. NaN samples are ignored.
+     */
+    void stage(uint64_t bssid, float rssi_dbm);
+
+    /**
+     * @brief Advances every slot by one scan
+     *
+     * Slots with a staged sample take a measurement update, all others
+     * only grow their variance. Slots not seen for max_age scans are dropped.
+     */
+    void update();
+
+    /**
+     * @brief Reads the current estimate of bssid
+     *
+     * @return false when bssid has no slot
+     */
+    bool estimate(uint64_t bssid, RssiEstimate& out) const;
+
+    std::size_t size() const { return bssid_.size(); }
+
+private:
+    void remove_slot(std::size_t slot);
+
+    RssiFilterParams params_;
+    std::unordered_map<uint64_t, uint32_t> index_;
+
+    // structure of arrays, one entry per slot
+    std::vector<uint64_t> bssid_;
+    std::vector<float> sample_;
+    std::vector<float> has_sample_;     // 1 when sample_ holds a staged measurement, else 0
+    std::vector<float> ema_;
+    std::vector<float> x_;
+    std::vector<float> p_;
+    std::vector<uint32_t> age_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_RSSI_FILTER_H
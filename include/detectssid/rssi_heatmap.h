@@ -0,0 +1,89 @@
+/** Sparse signal strength map
+ *
+ *  Purpose: show operators where the signal of a target is strongest.
+ *  Samples are binned into square cells of a sparse grid. Cells are
+ *  grouped into fixed size tiles that are allocated only where the robot
+ *  has been, and each tile remembers whether it changed since it was
+ *  last published so that only changed tiles are sent.
+ *
+ *  Memory is bounded by max_tiles; when it is reached the tile that was
+ *  updated least recently is dropped.
+ *
+ */
+
+#ifndef DETECTSSID_RSSI_HEATMAP_H
+#define DETECTSSID_RSSI_HEATMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace detectssid
+{
+
+struct HeatmapParams
+{
+    double resolution;      // m, cell side
+    double z_resolution;    // m, height of a layer, 0 for a single 2D layer
+    uint32_t tile_cells;    // cells per tile side
+    std::size_t max_tiles;
+
+    HeatmapParams()
+        : resolution(0.5), z_resolution(0.0), tile_cells(32), max_tiles(1024)
+    {
+    }
+};
+
+struct HeatmapCell
+{
+    float mean;             // dBm
+    float max;              // dBm
+    uint32_t count;
+};
+
+struct HeatmapTile
+{
+    int32_t tx, ty, tz;     // tile index, the tile covers cells [tx, tx + 1) * tile_cells
+    bool dirty;
+    uint64_t last_update;
+    std::vector<HeatmapCell> cells;     // row major, tile_cells * tile_cells
+};
+
+class RssiHeatmap
+{
+public:
+    explicit RssiHeatmap(const HeatmapParams& params = HeatmapParams());
+
+    /**
+     * @brief Adds a sample measured at (x, y, z)
+     */
+    void add(double x, double y, double z, float rssi);
+
+    /**
+     * @brief Collects the tiles changed since the last call and clears their dirty flag
+     *
+     * @param[out] tiles - pointers valid until the next add()
+     */
+    void take_dirty(std::vector<const HeatmapTile*>& tiles);
+
+    /// lower corner of a tile in map coordinates
+    void tile_origin(const HeatmapTile& tile, double& x, double& y, double& z) const;
+
+    const HeatmapParams& params() const { return params_; }
+    std::size_t tiles() const { return tiles_.size(); }
+
+private:
+    static uint64_t key(int32_t tx, int32_t ty, int32_t tz);
+    HeatmapTile& tile(int32_t tx, int32_t ty, int32_t tz);
+    void evict_oldest();
+
+    HeatmapParams params_;
+    std::unordered_map<uint64_t, HeatmapTile> tiles_;
+    std::vector<uint64_t> dirty_;
+    uint64_t updates_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_RSSI_HEATMAP_H
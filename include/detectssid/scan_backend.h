@@ -0,0 +1,246 @@
+/** Sources of scan results
+ *
+ *  Purpose: the detector runs the same pipeline on scans of the wireless
+ *  interface and on recorded scans. A backend produces one scan per
+ *  detector cycle in two steps, scan() and read(), so the scan and
+ *  parse stages are still timed separately.
+ *
+ *  IwlistBackend runs the scan command of the current ScanPlan, and reads
+ *  the kernel's BSS cache ("iwlist <interface> scan last") for a first
+ *  result at startup.
+ *  ReplayBackend plays a scan recording (scan_recording.h) back in real
+ *  time, N times faster, or as fast as the pipeline goes. Replayed scans
+ *  keep their recorded times; play the bag of the same run with --clock
+ *  for the robot poses.
+ *
+ *  MonitorBackend captures beacons and probe responses on a monitor mode
+ *  interface through a TPACKET_V3 ring for scan_window seconds a scan,
+ *  instead of asking the driver to scan, and can keep the frames in
+ *  pcapng files. The interface is put in monitor mode beforehand, e.g.
+ *  "iw phy phy0 interface add mon0 type monitor". PcapBackend runs the
+ *  pipeline on such a capture as fast as it goes, one scan per window.
+ *
+ *  SimulatorBackend makes scans up from networks at known positions and
+ *  the robot pose from tf: log-distance path loss, Gaussian shadowing,
+ *  random dropouts, a sensitivity floor, and scans of random length with
+ *  every beacon heard at a random moment of the scan. It sleeps through
+ *  a scan on ROS time, so it follows /use_sim_time and a bag played with
+ *  --clock at any rate. With own_clock it publishes /clock itself and
+ *  runs as fast as the pipeline goes, each process its own experiment.
+ *
+ */
+
+#ifndef DETECTSSID_SCAN_BACKEND_H
+#define DETECTSSID_SCAN_BACKEND_H
+
+#include <chrono>
+#include <memory>           // shared_ptr
+#include <random>
+#include <string>
+#include <vector>
+#include "ros/ros.h"
+
+
+#include "detectssid/beacon_frame.h"
+#include "detectssid/bss.h"
+#include "detectssid/path_loss.h"
+#include "detectssid/pcapng.h"
+#include "detectssid/pose_history.h"
+#include "detectssid/scan_config.h"
+#include "detectssid/scan_recording.h"
+
+namespace detectssid
+{
+
+class ScanBackend
+{
+public:
+    virtual ~ScanBackend() {}
+
+    /// picks up changed scan settings, called from the scan thread
+    virtual void configure(const ScanConfig&) {}
+
+    /**
+     * @brief Runs one scan
+     *
+     * @param[out] scan_done - time the scan completed
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    virtual int scan(ros::Time& scan_done) = 0;
+
+    /**
+     * @brief Reads what the radio already knows, e.g. after a restart, instead of scanning
+     *
+     * @return 0 upon success, then read() returns the result, -1 when the backend keeps no cache
+     */
+    virtual int scan_cached(ros::Time&) { return -1; }
+
+    /// parses the result of the last scan into records
+    virtual void read(std::vector<BssRecord>& records) = 0;
+
+    /// true when the backend keeps its own pace, the detector then does not sleep between cycles
+    virtual bool paced() const { return false; }
+
+    /// true when no scans are left
+    virtual bool finished() const { return false; }
+};
+
+class IwlistBackend : public ScanBackend
+{
+public:
+    void configure(const ScanConfig& config);
+    int scan(ros::Time& scan_done);
+    int scan_cached(ros::Time& scan_done);
+    void read(std::vector<BssRecord>& records);
+
+private:
+    std::shared_ptr<const ScanPlan> plan_;
+    std::string text_;
+};
+
+class ReplayBackend : public ScanBackend
+{
+public:
+    /**
+     * @param[in] speed - 1 real time, 2 twice as fast, 0 as fast as possible
+     */
+    explicit ReplayBackend(double speed);
+
+    /// @return 0 upon success, -1 upon failure
+    int open(const char* filename);
+
+    int scan(ros::Time& scan_done);
+    void read(std::vector<BssRecord>& records);
+    bool paced() const { return true; }
+    bool finished() const { return finished_; }
+
+private:
+    ScanRecording recording_;
+    double speed_;
+    bool started_;
+    bool finished_;
+    uint64_t first_ns_;
+    std::chrono::steady_clock::time_point start_;
+    std::vector<BssRecord> records_;
+    uint64_t next_ns_;
+    std::vector<BssRecord> next_;
+};
+
+class MonitorBackend : public ScanBackend
+{
+public:
+    /// @param[in] window - capture time of a scan, s
+    explicit MonitorBackend(double window);
+    ~MonitorBackend();
+
+    /**
+     * @brief Maps a capture ring on the monitor mode interface ifname
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int open(const char* ifname);
+
+    /// keeps the captured frames, see PcapngWriter::open()
+    int open_capture(const char* prefix, std::size_t max_file_bytes, int max_files);
+
+    int scan(ros::Time& scan_done);
+    void read(std::vector<BssRecord>& records);
+    bool paced() const { return true; }
+
+private:
+    MonitorBackend(const MonitorBackend&);
+    MonitorBackend& operator=(const MonitorBackend&);
+
+    void drain_block(uint8_t* block);
+
+    double window_;
+    int fd_;
+    uint8_t* ring_;
+    std::size_t block_size_;
+    std::size_t block_count_;
+    std::size_t next_block_;
+    PcapngWriter capture_;
+    BeaconTable beacons_;
+    std::vector<BssRecord> records_;
+};
+
+class PcapBackend : public ScanBackend
+{
+public:
+    /// @param[in] window - capture time of a scan, s
+    explicit PcapBackend(double window);
+
+    /// @return 0 upon success, -1 upon failure
+    int open(const char* filename);
+
+    int scan(ros::Time& scan_done);
+    void read(std::vector<BssRecord>& records);
+    bool paced() const { return true; }
+    bool finished() const { return finished_; }
+
+private:
+    PcapngReader reader_;
+    double window_;
+    bool finished_;
+    PcapngPacket packet_;       // first frame of the next window
+    BeaconTable beacons_;
+    std::vector<BssRecord> records_;
+};
+
+/**
+ * @brief A simulated access point, position in the map frame
+ */
+struct SimulatedNetwork
+{
+    uint64_t bssid;
+    std::string ssid;
+    double x, y, z;
+};
+
+struct SimulatorParams
+{
+    PathLossModel path_loss;    // sigma is the shadowing, none when 0
+    double dropout;             // chance a network above the floor is missing from a scan
+    double sensitivity;         // dBm, weaker networks are not heard
+    double scan_time;           // s, mean length of a scan
+    double scan_jitter;         // s, scans last scan_time +- scan_jitter
+    bool own_clock;             // publish /clock and never sleep
+    double robot_x, robot_y, robot_z;  // robot position while tf has no pose
+    uint32_t seed;
+
+    SimulatorParams()
+        : dropout(0.1), sensitivity(-90.0), scan_time(3.0), scan_jitter(0.5), own_clock(false),
+          robot_x(0.0), robot_y(0.0), robot_z(0.0), seed(1)
+    {
+    }
+};
+
+class SimulatorBackend : public ScanBackend
+{
+public:
+    /**
+     * @param[in] networks - the simulated access points, phones among them
+     * @param[in] poses - robot poses, sampled from tf by the detector
+     * @param[in] n - node handle for the /clock publisher
+     */
+    SimulatorBackend(const SimulatorParams& params, const std::vector<SimulatedNetwork>& networks,
+                     const PoseHistory* poses, ros::NodeHandle& n);
+
+    int scan(ros::Time& scan_done);
+    void read(std::vector<BssRecord>& records);
+    bool paced() const { return params_.own_clock; }
+
+private:
+    SimulatorParams params_;
+    std::vector<SimulatedNetwork> networks_;
+    const PoseHistory* poses_;
+    std::mt19937 rng_;
+    ros::Publisher clock_pub_;
+    ros::Time clock_;
+    std::vector<BssRecord> records_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_SCAN_BACKEND_H
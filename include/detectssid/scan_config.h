@@ -0,0 +1,114 @@
+/** Scan settings that can change while the detector runs
+ *
+ *  Purpose: the target ssid, the scan output file, the loop rate and the
+ *  publisher queue size are set through rosparam and dynamic_reconfigure.
+ *  A reconfigure callback builds a new ScanConfig and swaps it in with
+ *  one atomic store, the scan thread picks it up at the start of the
+ *  next cycle. Configs are immutable once published, so a cycle always
+ *  sees one consistent set of settings.
+ *
+ *  The matcher and the scan plan are precomputed from their settings and
+ *  shared with the previous config when their settings did not change.
+ *
+ */
+
+#ifndef DETECTSSID_SCAN_CONFIG_H
+#define DETECTSSID_SCAN_CONFIG_H
+
+#include <cstddef>
+#include <memory>           // shared_ptr
+#include <string>
+#include <vector>
+
+#include "detectssid/bss.h"
+
+namespace detectssid
+{
+
+/**
+ * @brief Finds the target ssid in scan records
+ *
+ * Boyer-Moore-Horspool search with the skip table built once per target,
+ * same results as search_bss_records().
+ */
+class TargetMatcher
+{
+public:
+    explicit TargetMatcher(const std::string& target);
+
+    const std::string& target() const { return target_; }
+
+    /**
+     * @brief Searches the records from match_index on for the target
+     *
+     * @param[out] network - target and the two characters after it, the
+     *                       name of the matching network, empty if not found
+     * @param[in,out] match_index - first record to search, index of the
+     *                              matching record upon return
+     *
+     * @return true when one of the records contains the target
+     */
+    bool search(const std::vector<BssRecord>& records, std::string& network,
+                std::size_t& match_index) const;
+
+private:
+    const char* find(const char* text, std::size_t len) const;
+
+    std::string target_;
+    std::size_t skip_[256];
+};
+
+/**
+ * @brief The scan command for one interface and output file
+ *
+ * iwlist is run directly, without a shell, and the lines the parser
+ * needs (Address, ESSID, Signal level, Last beacon) are written to
+ * ssid_filename. Neither name is ever read by a shell, so names set
+ * through dynamic_reconfigure cannot run commands.
+ */
+struct ScanPlan
+{
+    std::string ifname;
+    std::string ssid_filename;
+
+    /// an empty interface_name lets iwlist go through every interface
+    ScanPlan(const std::string& interface_name, const std::string& filename);
+
+    /**
+     * @brief Scans into ssid_filename, same as ssid_network_scan()
+     *
+     * @return 0 upon success, -1 when iwlist could not be run or failed
+     */
+    int scan() const;
+
+    /**
+     * @brief Copies the results the kernel holds from earlier scans into
+     * ssid_filename, without scanning
+     *
+     * @return 0 upon success, -1 upon failure or without an ifname, iwlist
+     * only takes "scan last" for a named interface
+     */
+    int scan_cached() const;
+};
+
+struct ScanConfig
+{
+    std::shared_ptr<const TargetMatcher> matcher;
+    std::shared_ptr<const ScanPlan> plan;
+    double loop_rate;       // Hz, continuous scanning
+    int queue_size;         // wifiAvailable and wifiDetection publishers
+};
+
+/**
+ * @brief Builds a config, reusing the parts of previous whose settings are unchanged
+ *
+ * @param[in] previous - current config, may be empty
+ */
+std::shared_ptr<const ScanConfig> make_scan_config(const std::shared_ptr<const ScanConfig>& previous,
+                                                   const std::string& target, const std::string& ifname,
+                                                   const std::string& ssid_filename,
+                                                   double loop_rate, int queue_size);
+
+} // namespace detectssid
+
+#endif // DETECTSSID_SCAN_CONFIG_H
@@ -0,0 +1,122 @@
+/** Recording of the scan results
+ *
+ *  Purpose: reproduce a field run offline. Every scan is appended to a
+ *  memory mapped file with its time, and ReplayBackend (scan_backend.h)
+ *  feeds the recorded scans back into the detector.
+ *
+ *  The file is append-only and every scan carries a CRC32, so a
+ *  recording cut short by a crash replays up to the last complete scan.
+ *  Opening a recording for writing replaces the file.
+ *
+ *  File layout, little endian:
+ *
+ *      header  8     magic "DSSIDSR1"
+ *              8     reserved
+ *      scan    4     CRC32 of the rest of the scan
+ *              4     length of the rest of the scan
+ *              8     time the scan completed, ns since the epoch
+ *              2     number of records
+ *              2     reserved
+ *      record  6     bssid
+ *              4     signal level, float dBm, NaN when not reported
+ *              4     last beacon age, float ms, NaN when not reported
+ *              1     ssid length
+ *              n     ssid text, as printed by iwlist
+ *
+ */
+
+#ifndef DETECTSSID_SCAN_RECORDING_H
+#define DETECTSSID_SCAN_RECORDING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "detectssid/bss.h"
+
+namespace detectssid
+{
+
+class ScanRecorder
+{
+public:
+    ScanRecorder();
+
+    /// trims the file to the recorded scans and closes it
+    ~ScanRecorder();
+
+    /**
+     * @brief Creates the recording file, replacing an existing one
+     *
+     * @param[in] capacity - initial file size, doubled whenever it is full
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int open(const char* filename, std::size_t capacity);
+
+    void close();
+
+    bool is_open() const { return base_ != NULL; }
+
+    /**
+     * @brief Appends one scan
+     *
+     * @param[in] time_ns - time the scan completed, ns since the epoch
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int append(uint64_t time_ns, const std::vector<BssRecord>& records);
+
+private:
+    ScanRecorder(const ScanRecorder&);
+    ScanRecorder& operator=(const ScanRecorder&);
+
+    int map(std::size_t capacity);
+
+    int fd_;
+    uint8_t* base_;
+    std::size_t capacity_;
+    std::size_t end_;
+};
+
+class ScanRecording
+{
+public:
+    ScanRecording();
+    ~ScanRecording();
+
+    /**
+     * @brief Maps a recording for reading
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int open(const char* filename);
+
+    void close();
+
+    /**
+     * @brief Reads the next scan
+     *
+     * @param[out] time_ns - time the scan completed
+     * @param[out] records - the access points of the scan
+     *
+     * @return false at the end of the recording, or at a torn scan
+     */
+    bool next(uint64_t& time_ns, std::vector<BssRecord>& records);
+
+    /// back to the first scan
+    void rewind();
+
+private:
+    ScanRecording(const ScanRecording&);
+    ScanRecording& operator=(const ScanRecording&);
+
+    const uint8_t* base_;
+    std::size_t size_;
+    std::size_t offset_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_SCAN_RECORDING_H
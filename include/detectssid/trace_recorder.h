@@ -0,0 +1,128 @@
+/** Timeline trace of the detection pipeline
+ *
+ *  Purpose: shows on a timeline where the scan thread, the service
+ *  threads and the publishers spend their time, e.g. a scan stalled by
+ *  comms traffic or a scan_now request waiting on a slow scan.
+ *
+ *  Every thread records its spans into its own ring buffer, with no lock
+ *  and no allocation; only the first span of a thread takes a lock to
+ *  register the buffer. flush() drains the buffers into a file in the
+ *  Chrome trace event format, which chrome://tracing and the Perfetto UI
+ *  open. The closing bracket is written by close(), a trace cut short
+ *  by a crash still loads. A full buffer drops spans, they are counted.
+ *
+ */
+
+#ifndef DETECTSSID_TRACE_RECORDER_H
+#define DETECTSSID_TRACE_RECORDER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>           // FILE
+#include <memory>           // unique_ptr
+#include <mutex>
+#include <vector>
+
+#include "detectssid/latency_histogram.h"      // monotonic_ns
+
+namespace detectssid
+{
+
+class TraceRecorder
+{
+public:
+    /**
+     * @param[in] events_per_thread - ring buffer size of each thread, spans
+     *                                recorded between two flushes
+     */
+    explicit TraceRecorder(std::size_t events_per_thread);
+
+    /// flushes and closes the file
+    ~TraceRecorder();
+
+    /**
+     * @brief Creates the trace file
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int open(const char* filename);
+
+    /**
+     * @brief Records a span of the calling thread
+     *
+     * @param[in] name - string literal, only the pointer is kept
+     * @param[in] start_ns, end_ns - monotonic_ns() times
+     */
+    void record(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+    /// writes the recorded spans to the file, from one thread at a time
+    void flush();
+
+    void close();
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    TraceRecorder(const TraceRecorder&);
+    TraceRecorder& operator=(const TraceRecorder&);
+
+    struct Event
+    {
+        const char* name;
+        uint64_t start_ns;
+        uint64_t end_ns;
+    };
+
+    // single producer, the owning thread, and single consumer, flush()
+    struct ThreadBuffer
+    {
+        int tid;
+        std::vector<Event> events;
+        std::atomic<uint64_t> head;     // written by the owner
+        std::atomic<uint64_t> tail;     // written by flush()
+        bool named;
+        char name[16];
+    };
+
+    ThreadBuffer* thread_buffer();
+
+    uint64_t id_;                       // tells recorders apart in the thread local cache
+    std::size_t capacity_;
+    std::mutex mutex_;                  // buffers_ and the file
+    std::vector<std::unique_ptr<ThreadBuffer> > buffers_;
+    FILE* fp_;
+    uint64_t origin_ns_;
+    std::atomic<uint64_t> dropped_;
+};
+
+/**
+ * @brief Records the span of a scope, nothing when recorder is null
+ */
+class TraceSpan
+{
+public:
+    TraceSpan(TraceRecorder* recorder, const char* name)
+        : recorder_(recorder), name_(name), start_(recorder ? monotonic_ns() : 0)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if(recorder_){
+            recorder_->record(name_, start_, monotonic_ns());
+        }
+    }
+
+private:
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+
+    TraceRecorder* recorder_;
+    const char* name_;
+    uint64_t start_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_TRACE_RECORDER_H
@@ -0,0 +1,67 @@
+/** Plain UDP datagram link
+ *
+ *  Purpose: carries detection batches to the base station outside of
+ *  ROS, one batch per datagram.
+ *
+ */
+
+#ifndef DETECTSSID_UDP_LINK_H
+#define DETECTSSID_UDP_LINK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/socket.h>     // sockaddr_storage, socklen_t
+
+namespace detectssid
+{
+
+class UdpLink
+{
+public:
+    UdpLink();
+    ~UdpLink();
+
+    /**
+     * @brief Opens a socket that sends to host:port
+     *
+     * @param[in] host - name or address of the receiver
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int open_sender(const char* host, uint16_t port);
+
+    /**
+     * @brief Opens a socket that receives on port, on all addresses
+     *
+     * @return 0 upon success, -1 upon failure
+     */
+    int open_receiver(uint16_t port);
+
+    void close();
+
+    bool is_open() const { return fd_ >= 0; }
+
+    /**
+     * @return 0 upon success, -1 upon failure
+     */
+    int send(const uint8_t* data, std::size_t len);
+
+    /**
+     * @brief Waits up to timeout_ms for one datagram
+     *
+     * @return size of the datagram, 0 on timeout, -1 upon failure
+     */
+    int receive(uint8_t* data, std::size_t capacity, int timeout_ms);
+
+private:
+    UdpLink(const UdpLink&);
+    UdpLink& operator=(const UdpLink&);
+
+    int fd_;
+    sockaddr_storage peer_;
+    socklen_t peer_len_;
+};
+
+} // namespace detectssid
+
+#endif // DETECTSSID_UDP_LINK_H
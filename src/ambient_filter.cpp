@@ -0,0 +1,197 @@
+/** Ambient access point filter
+ *
+ * File layout, host byte order:
+ *   char[8]   magic "DSSIDBF1"
+ *   uint64_t  bit mask (number of bits - 1)
+ *   uint32_t  number of hash functions
+ *   uint32_t  reserved, 0
+ *   uint64_t  number of learned BSSIDs
+ *   uint64_t  bits[(mask + 1) / 64]
+ *
+ */
+
+#include "detectssid/ambient_filter.h"
+
+#include <cerrno>
+#include <cmath>            // log, ceil
+#include <cstdio>           // fopen, fprintf
+#include <cstring>          // strerror, memcmp
+
+namespace detectssid
+{
+
+namespace
+{
+
+const char kMagic[8] = { 'D', 'S', 'S', 'I', 'D', 'B', 'F', '1' };
+
+/// splitmix64 finalizer, spreads the few varying bits of a MAC address
+uint64_t mix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+} // namespace
+
+
+AmbientFilter::AmbientFilter()
+    : mask_(0), hashes_(0), count_(0)
+{
+}
+
+
+void AmbientFilter::reset(std::size_t capacity, double fp_rate)
+{
+    if(capacity < 16){
+        capacity = 16;
+    }
+    if(fp_rate <= 0.0 || fp_rate >= 1.0){
+        fp_rate = 0.001;
+    }
+
+    // optimal bit count m = -n ln(p) / ln(2)^2, rounded up to a power of two
+    double m = -(double)capacity * std::log(fp_rate) / (M_LN2 * M_LN2);
+    uint64_t nbits = 64;
+    while((double)nbits < m){
+        nbits <<= 1;
+    }
+
+    // optimal hash count k = (m / n) ln(2)
+    double k = std::ceil((double)nbits / (double)capacity * M_LN2);
+    hashes_ = (uint32_t)(k < 1.0 ? 1.0 : (k > 16.0 ? 16.0 : k));
+
+    mask_ = nbits - 1;
+    bits_.assign(nbits / 64, 0);
+    count_ = 0;
+}
+
+
+bool AmbientFilter::insert(uint64_t bssid)
+{
+    if(bits_.empty()){
+        return false;
+    }
+
+    // Kirsch-Mitzenmacher double hashing, h_i = h1 + i * h2
+    uint64_t h1 = mix64(bssid);
+    uint64_t h2 = mix64(h1) | 1;
+    bool changed = false;
+
+    for(uint32_t i = 0; i < hashes_; ++i){
+        uint64_t bit = (h1 + i * h2) & mask_;
+        uint64_t word = bits_[bit >> 6];
+        uint64_t flag = 1ULL << (bit & 63);
+        if((word & flag) == 0){
+            bits_[bit >> 6] = word | flag;
+            changed = true;
+        }
+    }
+
+    if(changed){
+        ++count_;
+    }
+    return changed;
+}
+
+
+bool AmbientFilter::contains(uint64_t bssid) const
+{
+    if(bits_.empty()){
+        return false;
+    }
+
+    uint64_t h1 = mix64(bssid);
+    uint64_t h2 = mix64(h1) | 1;
+
+    for(uint32_t i = 0; i < hashes_; ++i){
+        uint64_t bit = (h1 + i * h2) & mask_;
+        if((bits_[bit >> 6] & (1ULL << (bit & 63))) == 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int AmbientFilter::save(const char* filename) const
+{
+    // write to a temporary file and rename so a crash never leaves a torn filter
+    char tmpname[4096];
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+
+    FILE* fp = fopen(tmpname, "wb");
+    if(fp == NULL){
+        fprintf(stderr, "could not write %s, errno: %s\n", tmpname, strerror(errno));
+        return -1;
+    }
+
+    uint32_t reserved = 0;
+    uint64_t count = count_;
+    bool ok = fwrite(kMagic, sizeof(kMagic), 1, fp) == 1
+           && fwrite(&mask_, sizeof(mask_), 1, fp) == 1
+           && fwrite(&hashes_, sizeof(hashes_), 1, fp) == 1
+           && fwrite(&reserved, sizeof(reserved), 1, fp) == 1
+           && fwrite(&count, sizeof(count), 1, fp) == 1
+           && fwrite(bits_.data(), sizeof(uint64_t), bits_.size(), fp) == bits_.size();
+
+    if(fclose(fp) != 0 || !ok){
+        fprintf(stderr, "could not write %s\n", tmpname);
+        remove(tmpname);
+        return -1;
+    }
+
+    if(rename(tmpname, filename) != 0){
+        fprintf(stderr, "could not rename %s, errno: %s\n", tmpname, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int AmbientFilter::load(const char* filename)
+{
+    FILE* fp = fopen(filename, "rb");
+    if(fp == NULL){
+        return -1;
+    }
+
+    char magic[8];
+    uint64_t mask = 0;
+    uint32_t hashes = 0;
+    uint32_t reserved = 0;
+    uint64_t count = 0;
+
+    bool ok = fread(magic, sizeof(magic), 1, fp) == 1
+           && memcmp(magic, kMagic, sizeof(kMagic)) == 0
+           && fread(&mask, sizeof(mask), 1, fp) == 1
+           && fread(&hashes, sizeof(hashes), 1, fp) == 1
+           && fread(&reserved, sizeof(reserved), 1, fp) == 1
+           && fread(&count, sizeof(count), 1, fp) == 1
+           // mask must be 2^n - 1 with at least 64 and at most 2^32 bits
+           && mask >= 63 && mask < (1ULL << 32) && ((mask + 1) & mask) == 0
+           && hashes >= 1 && hashes <= 16;
+
+    std::vector<uint64_t> bits;
+    if(ok){
+        bits.resize((mask + 1) / 64);
+        ok = fread(bits.data(), sizeof(uint64_t), bits.size(), fp) == bits.size();
+    }
+    fclose(fp);
+
+    if(!ok){
+        fprintf(stderr, "%s is not a valid ambient filter file\n", filename);
+        return -1;
+    }
+
+    bits_.swap(bits);
+    mask_ = mask;
+    hashes_ = hashes;
+    count_ = (std::size_t)count;
+    return 0;
+}
+
+} // namespace detectssid
@@ -0,0 +1,169 @@
+/** Access points from monitor mode frames
+ */
+
+#include "detectssid/beacon_frame.h"
+#include "detectssid/byte_order.h"
+
+#include <cmath>            // NAN
+#include <cstdio>           // snprintf
+
+namespace detectssid
+{
+
+namespace
+{
+
+// radiotap fields up to the antenna signal, (size, alignment) by present bit
+const uint8_t kFieldSize[6] = { 8, 1, 1, 4, 2, 1 };
+const uint8_t kFieldAlign[6] = { 8, 1, 1, 2, 1, 1 };
+const int kFlagsField = 1;
+const int kSignalField = 5;
+const uint8_t kFlagFcs = 0x10;      // frame ends with its 4 byte FCS
+
+const int kSubtypeProbeResponse = 5;
+const int kSubtypeBeacon = 8;
+const std::size_t kMacHeaderSize = 24;
+const std::size_t kFixedFields = 12;        // timestamp, interval, capabilities
+const uint8_t kSsidElement = 0;
+
+/// appends an ssid as iwlist prints it
+void escape_ssid(const uint8_t* ssid, std::size_t len, BssRecord& bss)
+{
+    std::size_t n = 0;
+    for(std::size_t i = 0; i < len; ++i){
+        uint8_t c = ssid[i];
+        if(c >= 0x20 && c < 0x7f && c != '\\'){
+            if(n + 1 > kMaxSsidText){
+                break;
+            }
+            bss.ssid[n++] = (char)c;
+        }
+        else{
+            if(n + 4 > kMaxSsidText){
+                break;
+            }
+            snprintf(bss.ssid + n, 5, "\\x%02X", c);
+            n += 4;
+        }
+    }
+    bss.ssid[n] = '\0';
+    bss.ssid_len = (uint8_t)n;
+}
+
+} // namespace
+
+
+bool parse_beacon_frame(const uint8_t* data, std::size_t len, BssRecord& bss)
+{
+    // radiotap header: version, pad, length, present bitmaps
+    if(len < 8 || data[0] != 0){
+        return false;
+    }
+    std::size_t header_len = data[2] | (std::size_t)data[3] << 8;
+    if(header_len < 8 || header_len > len){
+        return false;
+    }
+
+    uint32_t present = (uint32_t)get_le(data + 4, 4);
+    std::size_t offset = 8;
+    for(uint32_t more = present; more & 0x80000000u; offset += 4){
+        if(offset + 4 > header_len){
+            return false;
+        }
+        more = (uint32_t)get_le(data + offset, 4);
+    }
+
+    uint8_t flags = 0;
+    float signal_dbm = NAN;
+    for(int field = 0; field <= kSignalField; ++field){
+        if(!(present & (1u << field))){
+            continue;
+        }
+        offset = (offset + kFieldAlign[field] - 1) & ~(std::size_t)(kFieldAlign[field] - 1);
+        if(offset + kFieldSize[field] > header_len){
+            return false;
+        }
+        if(field == kFlagsField){
+            flags = data[offset];
+        }
+        else if(field == kSignalField){
+            signal_dbm = (float)(int8_t)data[offset];
+        }
+        offset += kFieldSize[field];
+    }
+
+    const uint8_t* frame = data + header_len;
+    std::size_t frame_len = len - header_len;
+    if(flags & kFlagFcs){
+        if(frame_len < 4){
+            return false;
+        }
+        frame_len -= 4;
+    }
+
+    // management frames, beacons and probe responses only
+    if(frame_len < kMacHeaderSize + kFixedFields){
+        return false;
+    }
+    int type = (frame[0] >> 2) & 3;
+    int subtype = frame[0] >> 4;
+    if(type != 0 || (subtype != kSubtypeBeacon && subtype != kSubtypeProbeResponse)){
+        return false;
+    }
+
+    bss.bssid = 0;
+    for(int i = 0; i < 6; ++i){
+        bss.bssid = bss.bssid << 8 | frame[16 + i];
+    }
+    bss.signal_dbm = signal_dbm;
+    bss.last_seen_ms = NAN;
+    bss.ssid[0] = '\0';
+    bss.ssid_len = 0;
+
+    // information elements, the ssid is usually the first
+    std::size_t ie = kMacHeaderSize + kFixedFields;
+    while(ie + 2 <= frame_len){
+        uint8_t id = frame[ie];
+        uint8_t ie_len = frame[ie + 1];
+        if(ie + 2 + ie_len > frame_len){
+            break;
+        }
+        if(id == kSsidElement){
+            escape_ssid(frame + ie + 2, ie_len, bss);
+            break;
+        }
+        ie += 2 + ie_len;
+    }
+    return true;
+}
+
+
+void BeaconTable::add(uint64_t time_ns, const uint8_t* data, std::size_t len)
+{
+    BssRecord bss;
+    if(!parse_beacon_frame(data, len, bss)){
+        return;
+    }
+
+    Beacon& beacon = beacons_[bss.bssid];      // a new entry is zeroed
+    if(time_ns >= beacon.time_ns){
+        beacon.time_ns = time_ns;
+        beacon.bss = bss;
+    }
+}
+
+
+void BeaconTable::take(uint64_t scan_done_ns, std::vector<BssRecord>& records)
+{
+    records.clear();
+    records.reserve(beacons_.size());
+    for(std::unordered_map<uint64_t, Beacon>::const_iterator it = beacons_.begin(); it != beacons_.end(); ++it){
+        records.push_back(it->second.bss);
+        BssRecord& bss = records.back();
+        bss.last_seen_ms = scan_done_ns > it->second.time_ns
+                         ? (float)((scan_done_ns - it->second.time_ns) * 1e-6) : 0.0f;
+    }
+    beacons_.clear();
+}
+
+} // namespace detectssid
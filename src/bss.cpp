@@ -0,0 +1,214 @@
+/** Basic service set (BSS) records parsed from a wireless scan
+ *
+ * Example iwlist cell, reduced by grep:
+ *
+ *          Cell 01 - Address: AA:BB:CC:DD:EE:FF
+ *                    Quality=56/70  Signal level=-54 dBm
+ *                    ESSID:"PhoneArtifact42"
+ *                    Extra: Last beacon: 24ms ago
+ *
+ * Some drivers report a relative level instead, "Signal level=60/100",
+ * which is mapped onto dBm the same way NetworkManager does, and some
+ * print "Signal level:-54 dBm".
+ *
+ */
+
+#include "detectssid/bss.h"
+
+#include <cmath>            // NAN
+#include <cstdio>           // snprintf
+#include <cstdlib>          // strtol
+#include <cstring>          // memcmp, memcpy
+#include <fcntl.h>          // open
+#include <unistd.h>         // read, close
+
+namespace detectssid
+{
+
+namespace
+{
+
+int hex_value(char c)
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/// returns a pointer to the first occurrence of key in [begin, end), or NULL
+const char* find_key(const char* begin, const char* end, const char* key, std::size_t key_len)
+{
+    if((std::size_t)(end - begin) < key_len){
+        return NULL;
+    }
+    const char* last = end - key_len;
+    for(const char* p = begin; p <= last; ++p){
+        p = (const char*)memchr(p, key[0], last - p + 1);
+        if(p == NULL){
+            return NULL;
+        }
+        if(memcmp(p, key, key_len) == 0){
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/// parses "-54 dBm" or "60/100" at value, returns NaN when neither form is present
+float parse_signal_level(const char* value, const char* eol)
+{
+    char number[16];
+    std::size_t n = 0;
+    while(value + n < eol && n < sizeof(number) - 1 && value[n] != ' '){
+        number[n] = value[n];
+        ++n;
+    }
+    number[n] = '\0';
+
+    char* rest;
+    long level = strtol(number, &rest, 10);
+    if(rest == number){
+        return NAN;
+    }
+    if(*rest == '/'){
+        long scale = strtol(rest + 1, NULL, 10);
+        if(scale <= 0){
+            return NAN;
+        }
+        // percentage p corresponds to p / 2 - 100 dBm
+        return (float)(level * 100 / scale) / 2.0f - 100.0f;
+    }
+    return (float)level;
+}
+
+} // namespace
+
+
+bool parse_bssid(const char* text, std::size_t len, uint64_t& bssid)
+{
+    if(len < 17){
+        return false;
+    }
+
+    uint64_t value = 0;
+    for(int octet = 0; octet < 6; ++octet){
+        const char* p = text + octet * 3;
+        int hi = hex_value(p[0]);
+        int lo = hex_value(p[1]);
+        if(hi < 0 || lo < 0 || (octet < 5 && p[2] != ':')){
+            return false;
+        }
+        value = (value << 8) | (uint64_t)(hi << 4 | lo);
+    }
+
+    bssid = value;
+    return true;
+}
+
+
+void format_bssid(uint64_t bssid, char* out)
+{
+    snprintf(out, 18, "%02X:%02X:%02X:%02X:%02X:%02X",
+             (unsigned)(bssid >> 40) & 0xff, (unsigned)(bssid >> 32) & 0xff,
+             (unsigned)(bssid >> 24) & 0xff, (unsigned)(bssid >> 16) & 0xff,
+             (unsigned)(bssid >> 8) & 0xff, (unsigned)bssid & 0xff);
+}
+
+
+std::size_t parse_iwlist_scan(const char* text, std::size_t len, std::vector<BssRecord>& records)
+{
+    static const char kAddress[] = "Address: ";
+    static const char kEssid[] = "ESSID:\"";
+    static const char kSignal[] = "Signal level";
+    static const char kLastBeacon[] = "Last beacon: ";
+
+    records.clear();
+
+    const char* end = text + len;
+    const char* line = text;
+    BssRecord* cell = NULL;
+
+    while(line < end){
+        const char* eol = (const char*)memchr(line, '\n', end - line);
+        if(eol == NULL){
+            eol = end;
+        }
+
+        const char* key;
+        if((key = find_key(line, eol, kAddress, sizeof(kAddress) - 1)) != NULL){
+            const char* value = key + sizeof(kAddress) - 1;
+            uint64_t bssid;
+            if(parse_bssid(value, eol - value, bssid)){
+                records.push_back(BssRecord());
+                cell = &records.back();
+                memset(cell, 0, sizeof(*cell));
+                cell->bssid = bssid;
+                cell->signal_dbm = NAN;
+                cell->last_seen_ms = NAN;
+            }
+            else{
+                cell = NULL;
+            }
+        }
+        else if(cell != NULL && (key = find_key(line, eol, kEssid, sizeof(kEssid) - 1)) != NULL){
+            // the ssid runs to the last quote on the line, it may contain quotes itself
+            const char* value = key + sizeof(kEssid) - 1;
+            const char* close = eol;
+            while(close > value && close[-1] != '"'){
+                --close;
+            }
+            std::size_t n = (close > value) ? (std::size_t)(close - 1 - value) : 0;
+            if(n > kMaxSsidText){
+                n = kMaxSsidText;
+            }
+            memcpy(cell->ssid, value, n);
+            cell->ssid[n] = '\0';
+            cell->ssid_len = (uint8_t)n;
+        }
+        else if(cell != NULL && (key = find_key(line, eol, kSignal, sizeof(kSignal) - 1)) != NULL){
+            const char* value = key + sizeof(kSignal) - 1;
+            if(value < eol && (*value == '=' || *value == ':')){
+                cell->signal_dbm = parse_signal_level(value + 1, eol);
+            }
+        }
+        else if(cell != NULL && (key = find_key(line, eol, kLastBeacon, sizeof(kLastBeacon) - 1)) != NULL){
+            const char* value = key + sizeof(kLastBeacon) - 1;
+            const char* rest = value;
+            long ms = 0;
+            while(rest < eol && *rest >= '0' && *rest <= '9' && ms < 100000000){
+                ms = ms * 10 + (*rest++ - '0');
+            }
+            if(rest != value && rest + 2 <= eol && rest[0] == 'm' && rest[1] == 's'){
+                cell->last_seen_ms = (float)ms;
+            }
+        }
+
+        line = eol + 1;
+    }
+
+    return records.size();
+}
+
+
+bool read_scan_file(const char* filename, std::string& buffer)
+{
+    buffer.clear();
+
+    // no stdio, fopen() allocates its FILE and buffer on every call
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        return false;
+    }
+
+    char chunk[4096];
+    ssize_t n;
+    while((n = read(fd, chunk, sizeof(chunk))) > 0){
+        buffer.append(chunk, (std::size_t)n);
+    }
+    close(fd);
+
+    return true;
+}
+
+} // namespace detectssid
@@ -0,0 +1,43 @@
+/** CRC32 of the files the detector writes
+ */
+
+#include "detectssid/crc32.h"
+
+namespace detectssid
+{
+
+namespace
+{
+
+struct Crc32Table
+{
+    uint32_t entries[256];
+
+    Crc32Table()
+    {
+        for(uint32_t i = 0; i < 256; ++i){
+            uint32_t c = i;
+            for(int k = 0; k < 8; ++k){
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+    }
+};
+
+// built before main, so crc32() is safe from any thread
+const Crc32Table table;
+
+} // namespace
+
+
+uint32_t crc32(const uint8_t* data, std::size_t len)
+{
+    uint32_t crc = 0xffffffffu;
+    for(std::size_t i = 0; i < len; ++i){
+        crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffffu;
+}
+
+} // namespace detectssid
@@ -0,0 +1,399 @@
+/** Detection cycle
+ *
+ * The part of Detector::spin_once() between reading the scan and
+ * publishing, see detection_cycle.h.
+ *
+ */
+
+#include "detectssid/detection_cycle.h"
+
+#include <cmath>            // NAN, isnan, sqrt
+#include <cstdio>           // fprintf
+#include <limits>           // numeric_limits
+
+namespace detectssid
+{
+
+/**
+ * @brief Removes the records of known ambient networks
+ * 
+ * @param[in] ambient - filter of learned ambient BSSIDs
+ * @param[in,out] records - scan records, ambient entries are erased
+ * 
+ * @return number of records removed
+ */
+std::size_t reject_ambient_networks(const AmbientFilter& ambient,
+                                    std::vector<BssRecord>& records)
+{
+    std::size_t kept = 0;
+
+    for(std::size_t i = 0; i < records.size(); ++i){
+        if(!ambient.contains(records[i].bssid)){
+            if(kept != i){
+                records[kept] = records[i];
+            }
+            ++kept;
+        }
+    }
+
+    std::size_t removed = records.size() - kept;
+    records.resize(kept);
+    return removed;
+}
+
+/**
+ * @brief Time a scan record was last seen
+ * 
+ * @param[in] bss - scan record
+ * @param[in] scan_done - time the scan completed
+ * 
+ * @return scan_done less the age of the last beacon, or scan_done when the
+ * driver does not report beacon ages
+ */
+ros::Time last_seen_time(const BssRecord& bss, const ros::Time& scan_done)
+{
+    if(std::isnan(bss.last_seen_ms)){
+        return scan_done;
+    }
+    return scan_done - ros::Duration(bss.last_seen_ms * 1e-3);
+}
+
+/**
+ * @brief Fills a detection message for one matching network
+ * 
+ * @param[in] bss - matching scan record
+ * @param[in] name - matched network name
+ * @param[in] scan_done - time the scan completed
+ * @param[in] map_frame - frame of the robot pose
+ * @param[in] pose_history - recent robot poses
+ * @param[in] rssi_filter - smoothed signal levels, already updated for this scan
+ * @param[out] detection - message to fill
+ * 
+ * The detection is stamped with the time the network was last seen and
+ * tagged with the robot pose at that time.
+ */
+void fill_detection(const BssRecord& bss, const std::string& name,
+                    const ros::Time& scan_done, const std::string& map_frame,
+                    const PoseHistory& pose_history,
+                    const RssiFilterBank& rssi_filter,
+                    Detection& detection)
+{
+    RssiEstimate rssi;
+    PoseSample pose;
+    char bssid_text[18];
+
+    // tag the detection with the robot pose when the beacon was received
+    detection.header.stamp = last_seen_time(bss, scan_done);
+    detection.header.frame_id = map_frame;
+    detection.pose_valid = pose_history.lookup(detection.header.stamp.toSec(), pose);
+    if(detection.pose_valid){
+        detection.robot_pose.position.x = pose.x;
+        detection.robot_pose.position.y = pose.y;
+        detection.robot_pose.position.z = pose.z;
+        detection.robot_pose.orientation.x = pose.qx;
+        detection.robot_pose.orientation.y = pose.qy;
+        detection.robot_pose.orientation.z = pose.qz;
+        detection.robot_pose.orientation.w = pose.qw;
+    }
+    else{
+        detection.robot_pose = geometry_msgs::Pose();
+    }
+
+    detection.ssid = name;
+    format_bssid(bss.bssid, bssid_text);
+    detection.bssid = bssid_text;
+    detection.rssi = bss.signal_dbm;
+    detection.cached = false;
+    if(rssi_filter.estimate(bss.bssid, rssi)){
+        detection.rssi_ema = rssi.ema;
+        detection.rssi_smoothed = rssi.smoothed;
+        detection.rssi_variance = rssi.variance;
+    }
+    else{
+        // driver reports no signal level
+        detection.rssi_ema = detection.rssi_smoothed = detection.rssi_variance = NAN;
+    }
+}
+
+/**
+ * @brief Fills a phone position estimate message
+ * 
+ * @param[in] detection - latest detection of the phone
+ * @param[in] position - localizer estimate
+ * @param[out] estimate - message to fill
+ * 
+ * Only the position is estimated, the orientation is identity and its
+ * covariance is set very large.
+ */
+void fill_estimate(const Detection& detection,
+                   const PositionEstimate& position,
+                   PhoneEstimate& estimate)
+{
+    estimate.header = detection.header;
+    estimate.ssid = detection.ssid;
+    estimate.bssid = detection.bssid;
+    estimate.observations = position.observations;
+
+    estimate.pose.pose.position.x = position.x;
+    estimate.pose.pose.position.y = position.y;
+    estimate.pose.pose.position.z = position.z;
+    estimate.pose.pose.orientation.x = 0.0;
+    estimate.pose.pose.orientation.y = 0.0;
+    estimate.pose.pose.orientation.z = 0.0;
+    estimate.pose.pose.orientation.w = 1.0;
+
+    for(int r = 0; r < 6; ++r){
+        for(int c = 0; c < 6; ++c){
+            double value = 0.0;
+            if(r < 3 && c < 3){
+                value = position.cov[r * 3 + c];
+            }
+            else if(r == c){
+                value = 1e6;
+            }
+            estimate.pose.covariance[r * 6 + c] = value;
+        }
+    }
+}
+
+
+DetectionCycle::DetectionCycle(const DetectionCycleParams& params, const PoseHistory* pose_history,
+                               PropagationMap* propagation, TraceRecorder* trace)
+    : params_(params), pose_history_(pose_history), propagation_(propagation), trace_(trace),
+      rssi_filter_(params.rssi), ambient_dirty_(false),
+      calibration_beacons_(params.calibration_beacons),
+      calibrator_(params.calibration_forgetting), path_loss_(params.path_loss),
+      calibration_dirty_(false),
+      summary_store_(params.summary_voxel_size, params.summary_z_voxel_size)
+{
+    // a pool holds the messages of the last two scans
+    records_.reserve(params_.max_networks);
+    phone_network_name_.reserve(kMaxSsidText);
+    detection_name_.reserve(kMaxSsidText);
+    detections_.reserve(params_.message_pool_size);
+    chatter_pool_.reserve(8);
+    detection_pool_.reserve(params_.message_pool_size);
+    estimate_pool_.reserve(params_.message_pool_size);
+    approach_pool_.reserve(8);
+
+    calibrator_.reset(path_loss_);
+
+    // every beacon has its entry before the first run
+    std::map<uint64_t, PoseSample>::const_iterator it;
+    for(it = calibration_beacons_.begin(); it != calibration_beacons_.end(); ++it){
+        calibration_last_time_[it->first] = -std::numeric_limits<double>::infinity();
+    }
+}
+
+
+uint64_t DetectionCycle::pool_misses() const
+{
+    return chatter_pool_.misses() + detection_pool_.misses() + estimate_pool_.misses()
+           + approach_pool_.misses();
+}
+
+
+int DetectionCycle::load_calibration(const char* filename)
+{
+    calibrator_.reset(path_loss_);
+    if(calibrator_.load(filename) != 0
+       || !calibrator_.apply(path_loss_, params_.calibration_min_samples)){
+        return -1;
+    }
+    return 0;
+}
+
+
+int DetectionCycle::save_calibration(const char* filename)
+{
+    calibration_dirty_ = calibrator_.save(filename) != 0;
+    return calibration_dirty_ ? -1 : 0;
+}
+
+
+int DetectionCycle::save_ambient(const char* filename)
+{
+    ambient_dirty_ = ambient_.save(filename) != 0;
+    return ambient_dirty_ ? -1 : 0;
+}
+
+
+void DetectionCycle::run(const ros::Time& scan_done, const TargetMatcher& matcher, DetectionSink& sink)
+{
+    std::size_t match_index = 0;
+
+    // the messages of the previous run go back to their pools once published
+    detections_.clear();
+    chatter_.reset();
+    chatter_ = chatter_pool_.get();
+
+    // calibration transmitters are usually ambient too, look at them before rejecting
+    if(!calibration_beacons_.empty()){
+        bool calibrated = false;
+        for(std::size_t i = 0; i < records_.size(); ++i){
+            std::map<uint64_t, PoseSample>::const_iterator beacon;
+            beacon = calibration_beacons_.find(records_[i].bssid);
+            if(beacon == calibration_beacons_.end() || std::isnan(records_[i].signal_dbm)){
+                continue;
+            }
+
+            // a cached beacon is a sample once, not once per scan that still lists it
+            double t = last_seen_time(records_[i], scan_done).toSec();
+            double& last_time = calibration_last_time_[records_[i].bssid];
+            PoseSample pose;
+            if(!(t > last_time) || !pose_history_->lookup(t, pose)){
+                continue;
+            }
+            last_time = t;
+
+            double dx = pose.x - beacon->second.x;
+            double dy = pose.y - beacon->second.y;
+            double dz = pose.z - beacon->second.z;
+            calibrator_.add(std::sqrt(dx * dx + dy * dy + dz * dz), records_[i].signal_dbm);
+            calibration_dirty_ = true;
+            calibrated = true;
+        }
+
+        if(calibrated){
+            calibrator_.apply(path_loss_, params_.calibration_min_samples);
+        }
+    }
+
+    if(params_.learn_ambient){
+        for(std::size_t i = 0; i < records_.size(); ++i){
+            ambient_dirty_ |= ambient_.insert(records_[i].bssid);
+        }
+    }
+    else if(!ambient_.empty()){
+        reject_ambient_networks(ambient_, records_);
+    }
+
+    for(std::size_t i = 0; i < records_.size(); ++i){
+        rssi_filter_.stage(records_[i].bssid, records_[i].signal_dbm);
+    }
+    rssi_filter_.update();
+
+    // search the wireless network ssid list for the phone artifact network
+    if( matcher.search(records_, phone_network_name_, match_index) ){
+        fprintf(stderr, "found %s\n", phone_network_name_.c_str());
+        chatter_->data = phone_network_name_;
+    }
+    else{
+        fprintf(stderr, "did not find %s\n", matcher.target().c_str());
+        chatter_->data.clear();
+    }
+    sink.on_matched();
+
+    // every matching network gets its own detection and position estimate
+    for(std::size_t i = 0; matcher.search(records_, detection_name_, i); ++i){
+        process_detection(records_[i], detection_name_, scan_done, sink);
+    }
+}
+
+
+void DetectionCycle::process_detection(const BssRecord& bss, const std::string& name,
+                                       const ros::Time& scan_done, DetectionSink& sink)
+{
+    TraceSpan span(trace_, "detection");
+
+    // published as shared pointers, not reused while anyone holds them
+    DetectionPtr detection_ptr = detection_pool_.get();
+    fill_detection(bss, name, scan_done, params_.map_frame, *pose_history_, rssi_filter_, *detection_ptr);
+    detections_.push_back(detection_ptr);
+    sink.on_detection(detection_ptr, bss);
+    const Detection& detection = *detection_ptr;
+
+    if(params_.closest_approach && detection.pose_valid){
+        std::map<uint64_t, PeakDetector>::iterator it = peak_detectors_.find(bss.bssid);
+        if(it == peak_detectors_.end()){
+            it = peak_detectors_.insert(std::make_pair(bss.bssid, PeakDetector(params_.peak))).first;
+        }
+
+        PoseSample pose;
+        PeakEvent peak;
+        pose.t = detection.header.stamp.toSec();
+        pose.x = detection.robot_pose.position.x;
+        pose.y = detection.robot_pose.position.y;
+        pose.z = detection.robot_pose.position.z;
+        pose.qx = detection.robot_pose.orientation.x;
+        pose.qy = detection.robot_pose.orientation.y;
+        pose.qz = detection.robot_pose.orientation.z;
+        pose.qw = detection.robot_pose.orientation.w;
+
+        if(it->second.add(pose, detection.rssi_smoothed, detection.rssi_variance, peak)){
+            ClosestApproachPtr approach = approach_pool_.get();
+            approach->header.stamp.fromSec(peak.pose.t);
+            approach->header.frame_id = detection.header.frame_id;
+            approach->ssid = detection.ssid;
+            approach->bssid = detection.bssid;
+            approach->robot_pose.position.x = peak.pose.x;
+            approach->robot_pose.position.y = peak.pose.y;
+            approach->robot_pose.position.z = peak.pose.z;
+            approach->robot_pose.orientation.x = peak.pose.qx;
+            approach->robot_pose.orientation.y = peak.pose.qy;
+            approach->robot_pose.orientation.z = peak.pose.qz;
+            approach->robot_pose.orientation.w = peak.pose.qw;
+            approach->rssi_peak = peak.rssi;
+            approach->prominence = peak.prominence;
+            sink.on_closest_approach(approach);
+        }
+    }
+
+    if(params_.heatmap && detection.pose_valid && !std::isnan(bss.signal_dbm)){
+        std::map<uint64_t, TargetHeatmap>::iterator it = heatmaps_.find(bss.bssid);
+        if(it == heatmaps_.end()){
+            TargetHeatmap target = { RssiHeatmap(params_.heatmap_params), -INFINITY };
+            it = heatmaps_.insert(std::make_pair(bss.bssid, target)).first;
+        }
+
+        double t = detection.header.stamp.toSec();
+        if(t > it->second.last_time){
+            it->second.last_time = t;
+            it->second.map.add(detection.robot_pose.position.x, detection.robot_pose.position.y,
+                               detection.robot_pose.position.z, bss.signal_dbm);
+        }
+    }
+
+    if(params_.summary && detection.pose_valid && !std::isnan(bss.signal_dbm)){
+        // cached beacons come back unchanged, each sample is counted once
+        double t = detection.header.stamp.toSec();
+        std::map<uint64_t, double>::iterator it = summary_last_time_.find(bss.bssid);
+        if(it == summary_last_time_.end() || t > it->second){
+            summary_last_time_[bss.bssid] = t;
+            summary_ssids_[bss.bssid] = detection.ssid;
+            summary_store_.add(bss.bssid, detection.robot_pose.position.x, detection.robot_pose.position.y,
+                               detection.robot_pose.position.z, bss.signal_dbm);
+        }
+    }
+
+    if(params_.localize && detection.pose_valid && !std::isnan(bss.signal_dbm)){
+        std::shared_ptr<Localizer>& localizer = localizers_[bss.bssid];
+        if(!localizer){
+            if(params_.localizer == "grid"){
+                localizer.reset(new GridLocalizer(params_.grid));
+            }
+            else{
+                localizer.reset(new ParticleFilter(params_.particle_filter, (uint32_t)bss.bssid));
+            }
+        }
+
+        RssiObservation obs;
+        obs.t = detection.header.stamp.toSec();
+        obs.x = detection.robot_pose.position.x;
+        obs.y = detection.robot_pose.position.y;
+        obs.z = detection.robot_pose.position.z;
+        obs.rssi = bss.signal_dbm;
+        const DistanceField* field = params_.map_aware ? propagation_->field(obs.x, obs.y) : NULL;
+        if(!localizer->update(obs, path_loss_, field)){
+            return;
+        }
+
+        PositionEstimate position;
+        localizer->estimate(position);
+        PhoneEstimatePtr estimate = estimate_pool_.get();
+        fill_estimate(detection, position, *estimate);
+        sink.on_estimate(estimate);
+    }
+}
+
+} // namespace detectssid
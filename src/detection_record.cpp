@@ -0,0 +1,171 @@
+/** Compact binary detection records
+ */
+
+#include "detectssid/detection_record.h"
+#include "detectssid/byte_order.h"
+
+#include <cmath>            // floor, isnan, NAN
+
+namespace detectssid
+{
+
+namespace
+{
+
+const uint8_t kMagic[2] = { 'D', 'R' };
+const uint8_t kVersion = 1;
+const uint8_t kPoseValid = 0x01;
+
+/// rounds value / step to int16, saturating; NaN becomes INT16_MIN
+int16_t quantize(double value, double step)
+{
+    if(std::isnan(value)){
+        return INT16_MIN;
+    }
+    double q = std::floor(value / step + 0.5);
+    if(q < INT16_MIN + 1){
+        return INT16_MIN + 1;
+    }
+    if(q > INT16_MAX){
+        return INT16_MAX;
+    }
+    return (int16_t)q;
+}
+
+double dequantize(int16_t q, double step)
+{
+    return q == INT16_MIN ? NAN : q * step;
+}
+
+} // namespace
+
+
+void encode_detection_record(const DetectionReport& report, uint64_t base_ms, uint8_t* out)
+{
+    uint64_t ms = (uint64_t)(report.t * 1000.0 + 0.5);
+
+    out[0] = report.target;
+    out[1] = report.pose_valid ? kPoseValid : 0;
+    put_le(out + 2, report.bssid, 6);
+    put_le(out + 8, (uint16_t)quantize(report.rssi, 0.1), 2);
+    put_le(out + 10, (uint16_t)quantize(report.rssi_smoothed, 0.1), 2);
+    put_le(out + 12, (uint16_t)quantize(report.x, 0.1), 2);
+    put_le(out + 14, (uint16_t)quantize(report.y, 0.1), 2);
+    put_le(out + 16, (uint16_t)quantize(report.z, 0.1), 2);
+    put_le(out + 18, (uint16_t)(ms - base_ms), 2);
+}
+
+
+void decode_detection_record(const uint8_t* data, uint64_t base_ms, DetectionReport& report)
+{
+    report.target = data[0];
+    report.pose_valid = (data[1] & kPoseValid) != 0;
+    report.bssid = get_le(data + 2, 6);
+    report.rssi = (float)dequantize((int16_t)(uint16_t)get_le(data + 8, 2), 0.1);
+    report.rssi_smoothed = (float)dequantize((int16_t)(uint16_t)get_le(data + 10, 2), 0.1);
+    report.x = dequantize((int16_t)(uint16_t)get_le(data + 12, 2), 0.1);
+    report.y = dequantize((int16_t)(uint16_t)get_le(data + 14, 2), 0.1);
+    report.z = dequantize((int16_t)(uint16_t)get_le(data + 16, 2), 0.1);
+    report.t = (base_ms + (uint16_t)get_le(data + 18, 2)) / 1000.0;
+}
+
+
+DetectionBatchEncoder::DetectionBatchEncoder(uint16_t sender, std::size_t max_records)
+    : sender_(sender), max_records_(max_records), sequence_(0), count_(0), base_ms_(0), last_ms_(0)
+{
+    if(max_records_ < 1){
+        max_records_ = 1;
+    }
+    if(max_records_ > 255){
+        max_records_ = 255;
+    }
+    buffer_.reserve(kBatchHeaderSize + max_records_ * kRecordSize);
+}
+
+
+bool DetectionBatchEncoder::add(const DetectionReport& report)
+{
+    if(count_ >= max_records_ || report.t < 0.0){
+        return false;
+    }
+
+    uint64_t ms = (uint64_t)(report.t * 1000.0 + 0.5);
+    if(count_ == 0){
+        base_ms_ = ms;
+        last_ms_ = ms;
+        buffer_.assign(kBatchHeaderSize, 0);
+    }
+    else{
+        // the base time is the oldest record, reports need not come in order
+        uint64_t first = ms < base_ms_ ? ms : base_ms_;
+        uint64_t last = ms > last_ms_ ? ms : last_ms_;
+        if(last - first > 0xffff){
+            return false;
+        }
+        if(first < base_ms_){
+            uint64_t shift = base_ms_ - first;
+            for(std::size_t i = 0; i < count_; ++i){
+                uint8_t* offset = &buffer_[kBatchHeaderSize + i * kRecordSize + 18];
+                put_le(offset, get_le(offset, 2) + shift, 2);
+            }
+            base_ms_ = first;
+        }
+        last_ms_ = last;
+    }
+
+    std::size_t offset = buffer_.size();
+    buffer_.resize(offset + kRecordSize);
+    encode_detection_record(report, base_ms_, &buffer_[offset]);
+
+    ++count_;
+    return true;
+}
+
+
+void DetectionBatchEncoder::take(std::vector<uint8_t>& out)
+{
+    out.clear();
+    if(count_ == 0){
+        return;
+    }
+
+    uint8_t* p = &buffer_[0];
+    p[0] = kMagic[0];
+    p[1] = kMagic[1];
+    p[2] = kVersion;
+    p[3] = (uint8_t)count_;
+    put_le(p + 4, sequence_, 2);
+    put_le(p + 6, sender_, 2);
+    put_le(p + 8, base_ms_, 8);
+
+    out.swap(buffer_);
+    buffer_.clear();
+    ++sequence_;
+    count_ = 0;
+}
+
+
+int decode_detection_batch(const uint8_t* data, std::size_t len, uint16_t& sender, uint16_t& sequence,
+                           std::vector<DetectionReport>& reports)
+{
+    reports.clear();
+    if(len < kBatchHeaderSize || data[0] != kMagic[0] || data[1] != kMagic[1] || data[2] != kVersion){
+        return -1;
+    }
+
+    std::size_t count = data[3];
+    if(len != kBatchHeaderSize + count * kRecordSize){
+        return -1;
+    }
+    sequence = (uint16_t)get_le(data + 4, 2);
+    sender = (uint16_t)get_le(data + 6, 2);
+    uint64_t base_ms = get_le(data + 8, 8);
+
+    reports.resize(count);
+    for(std::size_t i = 0; i < count; ++i){
+        decode_detection_record(data + kBatchHeaderSize + i * kRecordSize, base_ms, reports[i]);
+    }
+    return 0;
+}
+
+} // namespace detectssid
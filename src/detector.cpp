@@ -0,0 +1,1556 @@
+/** Phone network detector
+ *
+ * Note: the scans run a system command requiring sudo permission, see
+ * detect_ssid.cpp.
+ *
+ */
+
+#include "detectssid/detector.h"
+
+#include <ifaddrs.h>
+#include <unistd.h>         // gethostname
+#include <cerrno>
+#include <cstring>          // strerror
+#include <cstdio>           // fprintf
+
+#include <algorithm>        // search
+#include <chrono>
+#include <cmath>            // NAN, isnan
+#include <fstream>          // ifstream
+#include <random>           // random_device
+#include <boost/bind.hpp>
+#include "std_msgs/String.h"
+
+#include "detectssid/ClosestApproach.h"
+#include "detectssid/crc32.h"
+#include "detectssid/Detection.h"
+#include "detectssid/ObservationSummary.h"
+#include "detectssid/PhoneEstimate.h"
+
+namespace detectssid
+{
+
+/** 
+ * @brief Reads the first interface name that starts with the letter 'w'
+ * 
+ * @param[out] iface_name - contains wireless interface name. Argument is not
+ * changed if the ipAddress cannot be read.
+ * 
+ * @return 0 upon succcess, -1 upon failure
+ *
+ * Procedure:
+ * 
+ * Iterates through list of ifaddresses. Selects the first interface name
+ * that begins with the letter w. The address may be either AF_INET or AF_INET6.
+ * 
+ * Interface may start with the character 'w' or 'e'
+ * 
+ * Assigns the first ifaddress to data member ipAddress that is 
+ * either in the family AF_INET of AF_INET6. 
+ * 
+ * 
+ * Assumptions:
+ * 1) Interface names
+ *      wireless interfaces must start with the letter 'w'
+ *
+ * 2) It is assumed that network devices will not have more than one active
+ *    wireless interface. 
+ */
+int get_wireless_interface_name(std::string &iface_name)
+{
+    struct ifaddrs *ifaddr, *ifa;
+    int family;
+    
+    // find the inet ifaddress
+    if (getifaddrs(&ifaddr) == -1){
+        fprintf(stderr, "getifaddrs failure, errno: %s\n", strerror(errno));
+        return -1;
+    }
+
+    /* Walk through linked list, maintaining head pointer so we can free list later */
+    for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr == NULL){
+            continue;
+        }
+
+        family = ifa->ifa_addr->sa_family;
+
+        /* For debugging, sisplay interface name and family (including symbolic
+            form of the latter for the common families) 
+        fprintf(stderr, "interface: %8s,  address family: %2d %12s\n",
+                    ifa->ifa_name, family,
+                    (family == AF_PACKET) ? "(AF_PACKET)" :
+                    (family == AF_INET) ?   "(AF_INET)" :
+                    (family == AF_INET6) ?  "(AF_INET6)" : "unknown");
+        */
+        
+        if (family == AF_INET || family == AF_INET6) {
+                     
+            /* choose the first interface that starts with a w 
+               and is not a loopback interface. 
+               Assumes wireless interface will start with w
+            */
+            if(ifa->ifa_name[0] == 'w' && ifa->ifa_name[2]=='x')
+            {
+                fprintf(stderr, "selecting this interface: %s\n", ifa->ifa_name);
+                iface_name = std::string(ifa->ifa_name);
+                break;
+            }
+        }
+    }
+
+    freeifaddrs(ifaddr);
+
+    if(ifa == NULL){
+        fprintf(stderr, "ifa NULL, no interface selected\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Searches for phone artifact network ssid
+ * 
+ * @param[in] ssid_filename - contains list of available network SSID's
+ * @param[in] phone_artifact_ssid - target ssid to be found
+ * @param[out] phone_network - contains name of phone artifact network if found.
+ *                             Otherwise, empty string
+ * 
+ * @return true when phone_artifact_ssid is found in the file ssid_filename,
+ * Otherwise, returns false.
+ * 
+ * Note: only searches the file for the first occurence of the phone artifact
+ * ssid. If there multiple phones in the same area, then this code should
+ * be modified to reflect that possibility.
+ * 
+ * 
+ * From DARPA Subterranean Challenge forum
+ * https://community.subtchallenge.com/t/cell-phone-enabled-wifi-ap/803
+ * 
+ * The cell phone will be running in "Hotspot" mode and thus the WIFI radio 
+ * will be operating as an access point. Each cell phone artifact will broadcast 
+ * its SSID over WIFI, which will be in the form of "PhoneArtifactXX" where XX 
+ * will be a two-digit randomized number. The cell phone access point will employ 
+ * WPS encryption and will not accept connections from team platforms
+ * 
+ * 
+ */
+
+bool search_for_phone_ssid(const char* ssid_filename, const char* phone_artifact_ssid, std::string& phone_network)
+{
+    std::size_t found;
+
+    phone_network.clear();
+
+    // open the file
+    std::ifstream infile(ssid_filename);
+    if(!infile){
+        return false;
+    }
+
+    // read entire file into string
+    std::string file_contents = { std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>() };
+    infile.close();
+
+    // search for phone artifact string
+    found = file_contents.find(phone_artifact_ssid);
+    if(found != std::string::npos){
+        
+        // add 2 for XX, two digit randomized number
+        phone_network = file_contents.substr(found, strlen(phone_artifact_ssid) + 2);
+        return true;
+    }
+
+    return false;
+    
+}
+
+/**
+ * @brief Searches parsed scan records for phone artifact network ssid
+ * 
+ * @param[in] records - access points from the latest scan
+ * @param[in] phone_artifact_ssid - target ssid to be found
+ * @param[out] phone_network - contains name of phone artifact network if found.
+ *                             Otherwise, empty string
+ * @param[in,out] match_index - first record to search, index of the matching
+ *                              record upon return, unchanged if not found
+ * 
+ * @return true when phone_artifact_ssid is found in one of the records,
+ * Otherwise, returns false.
+ * 
+ * Same result as search_for_phone_ssid(), but only the ssid text of each
+ * record is searched, so records already rejected (e.g. ambient networks)
+ * cost nothing.
+ */
+bool search_bss_records(const std::vector<BssRecord>& records,
+                        const char* phone_artifact_ssid, std::string& phone_network,
+                        std::size_t& match_index)
+{
+    std::size_t target_len = strlen(phone_artifact_ssid);
+
+    phone_network.clear();
+
+    for(std::size_t i = match_index; i < records.size(); ++i){
+        const BssRecord& bss = records[i];
+        const char* found = std::search(bss.ssid, bss.ssid + bss.ssid_len,
+                                        phone_artifact_ssid, phone_artifact_ssid + target_len);
+        if(found != bss.ssid + bss.ssid_len){
+            // add 2 for XX, two digit randomized number
+            std::size_t n = std::min<std::size_t>(target_len + 2, bss.ssid + bss.ssid_len - found);
+            phone_network.assign(found, n);
+            match_index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief scans for available network ssid's
+ * 
+ * @param[in] ifname - wireless device interface name
+ * @param[in] ssid_filename - output filename 
+ * 
+ * Procedure:
+ *  runs iwlist to scan available wireless networks, see ScanPlan.
+ *  A list of network SSID's is stored in the file: ssid_filename.
+ * 
+ * Note: no shell
+ *  iwlist is run directly and its output filtered in the process, the
+ *  interface and file names are never parsed by /bin/sh.
+ * 
+ * Other system command options:
+ *  The command: nmcli -f SSID dev wifi
+ *  will often only return a single SSID, the network to which the 
+ *  wireless interface is connected, and not the list of all available 
+ *  wireless network connections. 
+ * 
+ *  Running the command: nmcli device wifi rescan 
+ *  will refresh the list, but sometimes you have to wait a few seconds.
+ * 
+ *  The command sudo iwlist [wifi interface] scan | grep SSID 
+ *  will return a list of available networks by the ESSID name.
+ *  The Address, Signal level and Last beacon lines are kept as well so
+ *  that each network can be identified by its BSSID, see parse_iwlist_scan().
+ * 
+ */
+void ssid_network_scan(const char *ifname, const char* ssid_filename)
+{
+    ScanPlan(ifname, ssid_filename).scan();
+}
+
+
+void PoseSampler::sample(const ros::TimerEvent&)
+{
+    tf::StampedTransform transform;
+    try{
+        listener->lookupTransform(map_frame, base_frame, ros::Time(0), transform);
+    }
+    catch(const tf::TransformException& ex){
+        ROS_WARN_THROTTLE(10.0, "no robot pose: %s", ex.what());
+        return;
+    }
+
+    const tf::Vector3& origin = transform.getOrigin();
+    tf::Quaternion rotation = transform.getRotation();
+    PoseSample pose;
+    pose.t = transform.stamp_.toSec();
+    pose.x = origin.x();
+    pose.y = origin.y();
+    pose.z = origin.z();
+    pose.qx = rotation.x();
+    pose.qy = rotation.y();
+    pose.qz = rotation.z();
+    pose.qw = rotation.w();
+    history->push(pose);
+}
+
+/**
+ * @brief Reads the known positions of calibration transmitters
+ * 
+ * @param[in] entries - one "AA:BB:CC:DD:EE:FF x y z" string per transmitter,
+ *                      position in the map frame
+ * @param[out] beacons - bssid to position
+ * 
+ * Malformed entries are reported and skipped.
+ */
+void parse_calibration_beacons(const std::vector<std::string>& entries,
+                               std::map<uint64_t, PoseSample>& beacons)
+{
+    beacons.clear();
+
+    for(std::size_t i = 0; i < entries.size(); ++i){
+        const std::string& entry = entries[i];
+        uint64_t bssid;
+        PoseSample position = PoseSample();
+
+        if(!parse_bssid(entry.c_str(), entry.size(), bssid)
+           || sscanf(entry.c_str() + 17, "%lf %lf %lf", &position.x, &position.y, &position.z) != 3){
+            ROS_WARN("ignoring calibration beacon \"%s\", expected \"AA:BB:CC:DD:EE:FF x y z\"", entry.c_str());
+            continue;
+        }
+        beacons[bssid] = position;
+    }
+}
+
+/**
+ * @brief Reads the networks of the scan simulator
+ * 
+ * @param[in] entries - one "AA:BB:CC:DD:EE:FF x y z SSID" string per network,
+ *                      position in the map frame, the ssid may hold spaces
+ * @param[out] networks - the parsed networks
+ * 
+ * Malformed entries are reported and skipped.
+ */
+void parse_simulated_networks(const std::vector<std::string>& entries,
+                              std::vector<SimulatedNetwork>& networks)
+{
+    networks.clear();
+
+    for(std::size_t i = 0; i < entries.size(); ++i){
+        const std::string& entry = entries[i];
+        SimulatedNetwork network;
+        int ssid_start = 0;
+
+        if(!parse_bssid(entry.c_str(), entry.size(), network.bssid)
+           || sscanf(entry.c_str() + 17, "%lf %lf %lf %n", &network.x, &network.y, &network.z, &ssid_start) != 3
+           || ssid_start == 0 || entry.c_str()[17 + ssid_start] == '\0'){
+            ROS_WARN("ignoring simulated network \"%s\", expected \"AA:BB:CC:DD:EE:FF x y z SSID\"", entry.c_str());
+            continue;
+        }
+        network.ssid = entry.substr(17 + ssid_start);
+        networks.push_back(network);
+    }
+}
+
+void MapListener::on_map(const nav_msgs::OccupancyGrid::ConstPtr& map)
+{
+    propagation->set_map(map->data.data(), map->info.width, map->info.height, map->info.resolution,
+                         map->info.origin.position.x, map->info.origin.position.y);
+}
+
+
+void MapListener::on_update(const map_msgs::OccupancyGridUpdate::ConstPtr& update)
+{
+    propagation->update_region(update->data.data(), update->x, update->y, update->width, update->height);
+}
+
+/**
+ * @brief Converts one heatmap tile into an occupancy grid
+ * 
+ * @param[in] heatmap - map the tile belongs to
+ * @param[in] tile - tile to convert
+ * @param[in] frame - map frame
+ * @param[in] min_dbm - level shown as 0
+ * @param[in] max_dbm - level shown as 100
+ * @param[out] grid - one grid per tile, placed at the tile origin
+ * 
+ * Each cell holds the mean level scaled to 0..100, cells without samples
+ * are -1 (unknown).
+ */
+void fill_heatmap_tile(const RssiHeatmap& heatmap, const HeatmapTile& tile,
+                       const std::string& frame, double min_dbm, double max_dbm,
+                       nav_msgs::OccupancyGrid& grid)
+{
+    const HeatmapParams& params = heatmap.params();
+    double scale = 100.0 / (max_dbm - min_dbm);
+
+    grid.header.stamp = ros::Time::now();
+    grid.header.frame_id = frame;
+    grid.info.map_load_time = grid.header.stamp;
+    grid.info.resolution = params.resolution;
+    grid.info.width = params.tile_cells;
+    grid.info.height = params.tile_cells;
+    heatmap.tile_origin(tile, grid.info.origin.position.x, grid.info.origin.position.y,
+                        grid.info.origin.position.z);
+    grid.info.origin.orientation.w = 1.0;
+
+    grid.data.resize(tile.cells.size());
+    for(std::size_t i = 0; i < tile.cells.size(); ++i){
+        const HeatmapCell& cell = tile.cells[i];
+        if(cell.count == 0){
+            grid.data[i] = -1;
+            continue;
+        }
+        double value = (cell.mean - min_dbm) * scale;
+        grid.data[i] = (int8_t)(value < 0.0 ? 0.0 : (value > 100.0 ? 100.0 : value + 0.5));
+    }
+}
+
+/**
+ * @brief Converts a detection into a compact report for the udp bridge
+ * 
+ * @param[in] detection - filled by fill_detection
+ * @param[in] bss - matching network of the detection
+ * @param[out] report - target id 0, the node searches for one target
+ */
+void fill_report(const Detection& detection, const BssRecord& bss,
+                 DetectionReport& report)
+{
+    report.target = 0;
+    report.pose_valid = detection.pose_valid;
+    report.bssid = bss.bssid;
+    report.rssi = detection.rssi;
+    report.rssi_smoothed = detection.rssi_smoothed;
+    report.x = detection.robot_pose.position.x;
+    report.y = detection.robot_pose.position.y;
+    report.z = detection.robot_pose.position.z;
+    report.t = detection.header.stamp.toSec();
+}
+
+/**
+ * @brief Converts a queued report back into a detection
+ * 
+ * @param[in] report - detection as stored by the forward queue
+ * @param[in] name - network name as queued with the report
+ * @param[in] map_frame - frame of the robot position
+ * @param[out] detection - orientation is identity, rssi_ema and
+ * rssi_variance are NaN, they are not stored
+ */
+void fill_forwarded(const DetectionReport& report, const std::string& name,
+                    const std::string& map_frame, Detection& detection)
+{
+    char bssid_text[18];
+
+    detection.header.stamp.fromSec(report.t);
+    detection.header.frame_id = map_frame;
+    detection.ssid = name;
+    format_bssid(report.bssid, bssid_text);
+    detection.bssid = bssid_text;
+    detection.rssi = report.rssi;
+    detection.rssi_ema = NAN;
+    detection.rssi_smoothed = report.rssi_smoothed;
+    detection.rssi_variance = NAN;
+    detection.pose_valid = report.pose_valid;
+    detection.cached = false;
+    detection.robot_pose.position.x = report.x;
+    detection.robot_pose.position.y = report.y;
+    detection.robot_pose.position.z = report.z;
+    detection.robot_pose.orientation.x = 0.0;
+    detection.robot_pose.orientation.y = 0.0;
+    detection.robot_pose.orientation.z = 0.0;
+    detection.robot_pose.orientation.w = 1.0;
+}
+
+void LinkMonitor::on_heartbeat(const std_msgs::Empty::ConstPtr&)
+{
+    last_heartbeat = ros::WallTime::now();
+}
+
+
+bool LinkMonitor::up() const
+{
+    return (ros::WallTime::now() - last_heartbeat).toSec() < timeout;
+}
+
+/**
+ * @brief Converts summary voxels into a summary message, grouped by target
+ * 
+ * @param[in] entries - voxels, e.g. from SummaryStore::take_changes
+ * @param[in] ssids - network name of each target
+ * @param[out] summary - targets are appended, header and robot_id are left
+ * to the caller
+ */
+void fill_summary(const std::vector<VoxelEntry>& entries,
+                  const std::map<uint64_t, std::string>& ssids,
+                  ObservationSummary& summary)
+{
+    std::map<uint64_t, std::size_t> target_index;
+
+    summary.targets.clear();
+    for(std::size_t i = 0; i < entries.size(); ++i){
+        const VoxelKey& key = entries[i].first;
+        const VoxelStatistics& stats = entries[i].second;
+
+        std::map<uint64_t, std::size_t>::iterator it = target_index.find(key.target);
+        if(it == target_index.end()){
+            it = target_index.insert(std::make_pair(key.target, summary.targets.size())).first;
+            summary.targets.push_back(TargetSummary());
+            char bssid[18];
+            format_bssid(key.target, bssid);
+            summary.targets.back().bssid = bssid;
+            std::map<uint64_t, std::string>::const_iterator name = ssids.find(key.target);
+            if(name != ssids.end()){
+                summary.targets.back().ssid = name->second;
+            }
+        }
+
+        VoxelSummary voxel;
+        voxel.x = key.x;
+        voxel.y = key.y;
+        voxel.z = key.z;
+        voxel.count = stats.count;
+        voxel.sum = stats.sum;
+        voxel.sum_sq = stats.sum_sq;
+        voxel.max = stats.max;
+        summary.targets[it->second].voxels.push_back(voxel);
+    }
+}
+
+
+/// name of this host, "detectssid" when it cannot be read
+std::string host_name()
+{
+    char host[256];
+    if(gethostname(host, sizeof(host)) != 0){
+        return "detectssid";
+    }
+    host[sizeof(host) - 1] = '\0';
+    return host;
+}
+
+
+/// the host name, the same across restarts; the summary incarnation tells the runs apart
+std::string default_robot_id()
+{
+    return host_name();
+}
+
+
+/// udp bridge sender id from the host name, the robots of a mesh have different ones
+uint16_t default_bridge_sender()
+{
+    std::string host = host_name();
+    uint32_t crc = crc32((const uint8_t*)host.data(), host.size());
+    return (uint16_t)(crc ^ crc >> 16);
+}
+
+
+/// Detector stages in the latency diagnostics and the trace, by Detector::Stage
+const char* const kStageNames[] = { "scan", "parse", "match", "publish", "cycle" };
+
+
+Detector::Detector(const ros::NodeHandle& n, const ros::NodeHandle& pn)
+    : n_(n), pn_(pn), stopped_(false), loop_rate_(20), timed_(false), stage_start_(0),
+      scan_requested_(false), scanning_(false), scans_started_(0), scans_done_(0)
+{
+    n_.setCallbackQueue(&queue_);
+
+    // scan settings, init() probes the interface unless wireless_interface is given
+    std::string target, ssid_filename;
+    double loop_rate;
+    int queue_size;
+    pn_.param<std::string>("target_ssid", target, "Pixel' hector");
+    if(target.empty()){
+        ROS_WARN("empty target_ssid matches every network, searching for Pixel' hector");
+        target = "Pixel' hector";
+    }
+    pn_.param<std::string>("ssid_filename", ssid_filename, "ssid_list.txt");
+    pn_.param("loop_rate", loop_rate, 20.0);
+    pn_.param("queue_size", queue_size, 1000);
+    pn_.param<std::string>("wireless_interface", wifiname_, "");
+    config_ = make_scan_config(std::shared_ptr<const ScanConfig>(), target, wifiname_, ssid_filename,
+                               loop_rate, queue_size);
+    active_config_ = config_;
+    loop_rate_ = ros::Rate(loop_rate);
+
+    // the other topics are advertised by init(), after the cached scan is out
+    chatter_pub_ = n_.advertise<std_msgs::String>("wifiAvailable", queue_size);
+
+    // scan source, and the recording of the scans
+    std::string record_filename;
+    int record_size;
+    pn_.param<std::string>("scan_backend", backend_type_, "iwlist");
+    pn_.param<std::string>("replay_file", replay_filename_, "scans.bin");
+    pn_.param("replay_speed", replay_speed_, 1.0);
+    pn_.param<std::string>("monitor_interface", monitor_interface_, "mon0");
+    pn_.param<std::string>("pcap_file", pcap_filename_, "capture.pcapng");
+    pn_.param("scan_window", scan_window_, 1.0);
+    pn_.param<std::string>("capture_file", capture_prefix_, "");
+    pn_.param("capture_file_size", capture_size_, 64 << 20);
+    pn_.param("capture_files", capture_files_, 4);
+
+    // scan simulator, its own path loss model so the localizer can be tried on a wrong one
+    std::vector<std::string> sim_entries;
+    int sim_seed;
+    pn_.param("sim_networks", sim_entries, std::vector<std::string>());
+    pn_.param("sim_path_loss_ref_power", sim_params_.path_loss.ref_power, sim_params_.path_loss.ref_power);
+    pn_.param("sim_path_loss_exponent", sim_params_.path_loss.exponent, sim_params_.path_loss.exponent);
+    pn_.param("sim_shadowing", sim_params_.path_loss.sigma, sim_params_.path_loss.sigma);
+    pn_.param("sim_dropout", sim_params_.dropout, sim_params_.dropout);
+    pn_.param("sim_sensitivity", sim_params_.sensitivity, sim_params_.sensitivity);
+    pn_.param("sim_scan_time", sim_params_.scan_time, sim_params_.scan_time);
+    pn_.param("sim_scan_jitter", sim_params_.scan_jitter, sim_params_.scan_jitter);
+    pn_.param("sim_own_clock", sim_params_.own_clock, sim_params_.own_clock);
+    pn_.param("sim_robot_x", sim_params_.robot_x, sim_params_.robot_x);
+    pn_.param("sim_robot_y", sim_params_.robot_y, sim_params_.robot_y);
+    pn_.param("sim_robot_z", sim_params_.robot_z, sim_params_.robot_z);
+    pn_.param("sim_seed", sim_seed, 0);
+    sim_params_.seed = sim_seed != 0 ? (uint32_t)sim_seed : std::random_device()();
+    parse_simulated_networks(sim_entries, sim_networks_);
+    pn_.param<std::string>("record_file", record_filename, "");
+    pn_.param("record_file_size", record_size, 1 << 20);
+    if(!record_filename.empty()){
+        scan_recorder_.reset(new ScanRecorder);
+        if(scan_recorder_->open(record_filename.c_str(), record_size) != 0){
+            scan_recorder_.reset();
+        }
+    }
+
+    // messages and buffers of a cycle, a pool holds the messages of the last two scans
+    DetectionCycleParams cycle_params;
+    int message_pool_size, max_networks;
+    pn_.param("message_pool_size", message_pool_size, 64);
+    pn_.param("max_networks", max_networks, 512);
+    cycle_params.message_pool_size = message_pool_size;
+    cycle_params.max_networks = max_networks;
+    last_detections_.reserve(message_pool_size);
+    pool_misses_ = 0;
+
+    // on demand scans, requests wait for a scan on their own threads, started by
+    // setup(); past scan_now_max_threads waiting requests queue behind each other
+    int scan_now_max_threads;
+    pn_.param("continuous_scan", continuous_scan_, true);
+    pn_.param("scan_timeout", scan_timeout_, 10.0);
+    pn_.param("scan_now_max_threads", scan_now_max_threads, 8);
+    scan_now_max_threads_ = scan_now_max_threads > 1 ? scan_now_max_threads : 1;
+    service_spinner_.reset(new ros::AsyncSpinner(1, &service_queue_));
+    service_spinner_->start();
+    advertise_detections(queue_size);
+    scan_now_quit_ = false;
+    scan_now_idle_ = 0;
+
+    // stage latency histograms, published by init() once the interface is known
+    bool latency_stats;
+    pn_.param("latency_stats", latency_stats, false);
+    if(latency_stats){
+        latency_.reset(new LatencyHistogram[kStages]);
+    }
+
+    // stage cpu cost, the counters are opened by run() on the scan thread
+    bool perf_counters;
+    pn_.param("perf_counters", perf_counters, false);
+    if(perf_counters){
+        perf_.reset(new PerfCounters(kCycleStage));
+    }
+    for(int i = 0; i < kPerfCounters; ++i){
+        perf_reported_[i] = 0;
+    }
+
+    // timeline trace, the buffers are drained to the file every trace_flush_period
+    std::string trace_filename;
+    int trace_buffer_size;
+    double trace_flush_period;
+    pn_.param<std::string>("trace_file", trace_filename, "");
+    pn_.param("trace_buffer_size", trace_buffer_size, 65536);
+    pn_.param("trace_flush_period", trace_flush_period, 1.0);
+    if(!trace_filename.empty()){
+        trace_.reset(new TraceRecorder(trace_buffer_size));
+        if(trace_->open(trace_filename.c_str()) != 0){
+            trace_.reset();
+        }
+        else{
+            ros::NodeHandle trace_nh(n);
+            trace_nh.setCallbackQueue(&service_queue_);
+            trace_timer_ = trace_nh.createWallTimer(ros::WallDuration(trace_flush_period),
+                                                    &Detector::on_trace_timer, this);
+        }
+    }
+
+    // signal level smoothing, one filter slot per novel network
+    RssiFilterParams& rssi_params = cycle_params.rssi;
+    double ema_alpha, process_noise, measurement_noise;
+    pn_.param("rssi_ema_alpha", ema_alpha, (double)rssi_params.ema_alpha);
+    pn_.param("rssi_process_noise", process_noise, (double)rssi_params.process_noise);
+    pn_.param("rssi_measurement_noise", measurement_noise, (double)rssi_params.measurement_noise);
+    rssi_params.ema_alpha = (float)ema_alpha;
+    rssi_params.process_noise = (float)process_noise;
+    rssi_params.measurement_noise = (float)measurement_noise;
+
+    // robot pose history, sampled from tf on a separate thread once setup() has a listener
+    double pose_max_gap;
+    int pose_capacity;
+    pn_.param<std::string>("map_frame", pose_sampler_.map_frame, "map");
+    pn_.param<std::string>("base_frame", pose_sampler_.base_frame, "base_link");
+    pn_.param("pose_history_size", pose_capacity, 512);
+    pn_.param("pose_max_gap", pose_max_gap, 0.5);
+
+    pose_history_.reset(new PoseHistory(pose_capacity, pose_max_gap));
+    pose_sampler_.history = pose_history_.get();
+    cycle_params.map_frame = pose_sampler_.map_frame;
+    pose_spinner_.reset(new ros::AsyncSpinner(1, &pose_queue_));
+    pose_spinner_->start();
+
+    // phone localization, one particle filter or grid localizer per matching bssid
+    int particles, grid_refine_cells;
+    ParticleFilterParams& pf_params = cycle_params.particle_filter;
+    GridLocalizerParams& grid_params = cycle_params.grid;
+    PathLossModel& path_loss = cycle_params.path_loss;
+    pn_.param("localize", cycle_params.localize, true);
+    pn_.param<std::string>("localizer", cycle_params.localizer, "particle");
+    pn_.param("particles", particles, (int)pf_params.particles);
+    pn_.param("init_radius", pf_params.init_radius, pf_params.init_radius);
+    pn_.param("init_height", pf_params.init_height, pf_params.init_height);
+    pn_.param("roughening", pf_params.roughening, pf_params.roughening);
+    pn_.param("path_loss_ref_power", path_loss.ref_power, path_loss.ref_power);
+    pn_.param("path_loss_exponent", path_loss.exponent, path_loss.exponent);
+    pn_.param("path_loss_sigma", path_loss.sigma, path_loss.sigma);
+    pn_.param("grid_search_radius", grid_params.search_radius, grid_params.search_radius);
+    pn_.param("grid_coarse_resolution", grid_params.coarse_resolution, grid_params.coarse_resolution);
+    pn_.param("grid_fine_resolution", grid_params.fine_resolution, grid_params.fine_resolution);
+    pn_.param("grid_refine_cells", grid_refine_cells, (int)grid_params.refine_cells);
+    pn_.param("grid_fit_ref_power", grid_params.fit_ref_power, grid_params.fit_ref_power);
+    pf_params.particles = particles;
+    grid_params.refine_cells = grid_refine_cells;
+    if(cycle_params.localizer != "particle" && cycle_params.localizer != "grid"){
+        ROS_WARN("unknown localizer \"%s\", using particle", cycle_params.localizer.c_str());
+        cycle_params.localizer = "particle";
+    }
+
+    // optional map aware propagation for the localizer
+    int propagation_cache_size;
+    PropagationParams propagation_params;
+    pn_.param("map_aware", cycle_params.map_aware, false);
+    pn_.param("propagation_resolution", propagation_params.resolution, propagation_params.resolution);
+    pn_.param("propagation_max_range", propagation_params.max_range, propagation_params.max_range);
+    pn_.param("wall_penalty", propagation_params.wall_penalty, propagation_params.wall_penalty);
+    pn_.param("propagation_cache_size", propagation_cache_size, (int)propagation_params.cache_size);
+    propagation_params.cache_size = propagation_cache_size;
+    propagation_.reset(new PropagationMap(propagation_params));
+    map_listener_.propagation = propagation_.get();
+
+    // closest approach events, a cheap alternative to the localizer
+    double peak_threshold, peak_drop, peak_max_stddev;
+    PeakDetectorParams& peak_params = cycle_params.peak;
+    pn_.param("closest_approach", cycle_params.closest_approach, true);
+    pn_.param("peak_threshold_dbm", peak_threshold, (double)peak_params.threshold_dbm);
+    pn_.param("peak_drop_db", peak_drop, (double)peak_params.drop_db);
+    pn_.param("peak_max_stddev_db", peak_max_stddev, (double)peak_params.max_stddev_db);
+    peak_params.threshold_dbm = (float)peak_threshold;
+    peak_params.drop_db = (float)peak_drop;
+    peak_params.max_stddev_db = (float)peak_max_stddev;
+
+    // signal strength maps, one per matching bssid, changed tiles published at heatmap_rate
+    int heatmap_tile_cells, heatmap_max_tiles;
+    HeatmapParams& heatmap_params = cycle_params.heatmap_params;
+    pn_.param("heatmap", cycle_params.heatmap, true);
+    pn_.param("heatmap_rate", heatmap_rate_, 1.0);
+    pn_.param("heatmap_resolution", heatmap_params.resolution, heatmap_params.resolution);
+    pn_.param("heatmap_z_resolution", heatmap_params.z_resolution, heatmap_params.z_resolution);
+    pn_.param("heatmap_tile_cells", heatmap_tile_cells, (int)heatmap_params.tile_cells);
+    pn_.param("heatmap_max_tiles", heatmap_max_tiles, (int)heatmap_params.max_tiles);
+    pn_.param("heatmap_min_dbm", heatmap_min_dbm_, -90.0);
+    pn_.param("heatmap_max_dbm", heatmap_max_dbm_, -30.0);
+    heatmap_params.tile_cells = heatmap_tile_cells;
+    heatmap_params.max_tiles = heatmap_max_tiles;
+    heatmap_published_ = ros::WallTime::now();
+
+    // observation summaries shared with other robots, changed voxels at
+    // summary_rate and every voxel each summary_full_every-th time; the
+    // namespace is / on every robot launched at the root, it is no id
+    pn_.param("summary", cycle_params.summary, true);
+    if(!pn_.getParam("robot_id", robot_id_) || robot_id_.empty()){
+        robot_id_ = default_robot_id();
+        if(cycle_params.summary){
+            ROS_WARN("robot_id not set, summaries are sent as %s", robot_id_.c_str());
+        }
+    }
+    summary_incarnation_ = ros::WallTime::now().toNSec();
+    pn_.param("summary_rate", summary_rate_, 0.2);
+    pn_.param("summary_voxel_size", cycle_params.summary_voxel_size, 2.0);
+    pn_.param("summary_z_voxel_size", cycle_params.summary_z_voxel_size, 0.0);
+    pn_.param("summary_full_every", summary_full_every_, 10);
+    summary_published_ = ros::WallTime::now();
+    summaries_sent_ = 0;
+
+    // path loss calibration from transmitters at known positions
+    std::vector<std::string> beacon_entries;
+    pn_.param("calibration_beacons", beacon_entries, std::vector<std::string>());
+    pn_.param<std::string>("calibration_file", calibration_filename_, "path_loss_calibration.yaml");
+    pn_.param("calibration_min_samples", cycle_params.calibration_min_samples, 20);
+    pn_.param("calibration_forgetting", cycle_params.calibration_forgetting, 0.999);
+    parse_calibration_beacons(beacon_entries, cycle_params.calibration_beacons);
+
+    // ambient network baseline: either learn it now, or load it and
+    // reject those networks before searching for the phone
+    int ambient_capacity;
+    double ambient_fp_rate;
+    pn_.param("learn_ambient", cycle_params.learn_ambient, false);
+    pn_.param<std::string>("ambient_filter_file", ambient_filename_, "ambient_bssids.bloom");
+    pn_.param("ambient_capacity", ambient_capacity, 4096);
+    pn_.param("ambient_fp_rate", ambient_fp_rate, 0.001);
+
+    // the cycle between the scan and the publishers, see detection_cycle.h
+    cycle_.reset(new DetectionCycle(cycle_params, pose_history_.get(), propagation_.get(), trace_.get()));
+
+    calibration_saved_ = ros::WallTime::now();
+    if(cycle_->load_calibration(calibration_filename_.c_str()) == 0){
+        const PathLossModel& loaded = cycle_->path_loss();
+        ROS_INFO("loaded path loss calibration from %s: ref_power %.1f dBm, exponent %.2f, sigma %.1f dB",
+                 calibration_filename_.c_str(), loaded.ref_power, loaded.exponent, loaded.sigma);
+    }
+
+    AmbientFilter& ambient = cycle_->ambient();
+    ambient_saved_ = ros::WallTime::now();
+    if(ambient.load(ambient_filename_.c_str()) == 0){
+        ROS_INFO("loaded %zu ambient networks from %s", ambient.count(), ambient_filename_.c_str());
+    }
+    else if(cycle_params.learn_ambient){
+        ambient.reset(ambient_capacity, ambient_fp_rate);
+    }
+    if(cycle_params.learn_ambient){
+        ROS_INFO("learning ambient networks into %s", ambient_filename_.c_str());
+    }
+
+}
+
+
+Detector::~Detector()
+{
+    stop();
+    service_spinner_->stop();
+    pose_spinner_->stop();
+
+    // stop() failed the waiting requests, no thread is added any more
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(scan_now_threads_mutex_);
+        scan_now_quit_ = true;
+        threads.swap(scan_now_threads_);
+    }
+    for(std::size_t i = 0; i < threads.size(); ++i){
+        threads[i].join();
+    }
+
+    if(cycle_->params().learn_ambient && cycle_->ambient_dirty()){
+        cycle_->save_ambient(ambient_filename_.c_str());
+    }
+    if(cycle_->calibration_dirty()){
+        cycle_->save_calibration(calibration_filename_.c_str());
+    }
+}
+
+
+int Detector::init()
+{
+    // a map aware grid search stops refining at the first observation, it would stay coarse
+    if(cycle_->params().localize && cycle_->params().localizer == "grid" && cycle_->params().map_aware){
+        ROS_ERROR("map_aware needs localizer particle, the grid localizer cannot refine map aware observations");
+        return -1;
+    }
+
+    if(backend_type_ == "replay"){
+        // recorded scans need no wireless interface
+        ReplayBackend* replay = new ReplayBackend(replay_speed_);
+        backend_.reset(replay);
+        if(replay->open(replay_filename_.c_str()) != 0){
+            return -1;
+        }
+        wifiname_ = "replay";
+    }
+    else if(backend_type_ == "monitor"){
+        // the interface is in monitor mode already, nothing to scan
+        MonitorBackend* monitor = new MonitorBackend(scan_window_);
+        backend_.reset(monitor);
+        if(monitor->open(monitor_interface_.c_str()) != 0){
+            return -1;
+        }
+        if(!capture_prefix_.empty()
+           && monitor->open_capture(capture_prefix_.c_str(), capture_size_, capture_files_) != 0){
+            ROS_WARN("could not write the capture, monitoring without it");
+        }
+        wifiname_ = monitor_interface_;
+    }
+    else if(backend_type_ == "pcap"){
+        PcapBackend* pcap = new PcapBackend(scan_window_);
+        backend_.reset(pcap);
+        if(pcap->open(pcap_filename_.c_str()) != 0){
+            return -1;
+        }
+        wifiname_ = "pcap";
+    }
+    else if(backend_type_ == "sim"){
+        if(sim_networks_.empty()){
+            ROS_WARN("no sim_networks, the simulated scans stay empty");
+        }
+        backend_.reset(new SimulatorBackend(sim_params_, sim_networks_, pose_history_.get(), n_));
+        wifiname_ = "sim";
+    }
+    else{
+        if(backend_type_ != "iwlist"){
+            fprintf(stderr, "unknown scan_backend %s, using iwlist\n", backend_type_.c_str());
+        }
+        backend_.reset(new IwlistBackend);
+    }
+
+    // read the local wifi interface name, unless it is given; the cached
+    // scan is read through "iwlist <interface> scan last" too
+    if(wifiname_.empty() && get_wireless_interface_name(wifiname_) != 0){
+        fprintf(stderr, "did not read wireless interface name\n");
+        return -1;
+    }
+
+    // nothing reconfigures yet, the config is applied right away
+    std::shared_ptr<const ScanConfig> config = std::atomic_load(&config_);
+    std::atomic_store(&config_, make_scan_config(config, config->matcher->target(), wifiname_,
+                                                 config->plan->ssid_filename, config->loop_rate,
+                                                 config->queue_size));
+    active_config_ = std::atomic_load(&config_);
+
+    publish_cached_scan();
+    setup();
+
+    // reconfigure requests are served by the service threads, the scan thread applies them
+    ros::NodeHandle reconfigure_nh(pn_);
+    reconfigure_nh.setCallbackQueue(&service_queue_);
+    reconfigure_server_.reset(new dynamic_reconfigure::Server<DetectorConfig>(reconfigure_nh));
+    reconfigure_server_->setCallback(boost::bind(&Detector::on_reconfigure, this, _1, _2));
+
+    // diagnostics are read on the service threads, the histograms and cost totals need no lock
+    if(latency_ || perf_){
+        diagnostics_.reset(new diagnostic_updater::Updater(n_, pn_));
+        diagnostics_->setHardwareID(wifiname_);
+        if(latency_){
+            diagnostics_->add("scan latency", this, &Detector::diagnose_latency);
+        }
+        if(perf_){
+            perf_reported_time_ = ros::WallTime::now();
+            diagnostics_->add("scan cpu cost", this, &Detector::diagnose_cost);
+        }
+        ros::NodeHandle diagnostics_nh(n_);
+        diagnostics_nh.setCallbackQueue(&service_queue_);
+        diagnostics_timer_ = diagnostics_nh.createWallTimer(ros::WallDuration(1.0),
+                                                            &Detector::on_diagnostics_timer, this);
+    }
+    return 0;
+}
+
+
+/// the result of the last scan before a restart, published before anything else is set up
+void Detector::publish_cached_scan()
+{
+    ros::Time scan_done;
+    backend_->configure(*active_config_);
+    if(backend_->scan_cached(scan_done) != 0){
+        return;
+    }
+    std::vector<BssRecord>& records = cycle_->records();
+    backend_->read(records);
+    if(!cycle_->params().learn_ambient && !cycle_->ambient().empty()){
+        reject_ambient_networks(cycle_->ambient(), records);
+    }
+
+    // no pose yet and no signal history, the detections only say what is around
+    const TargetMatcher& matcher = *active_config_->matcher;
+    std::string name;
+    std::lock_guard<std::mutex> lock(scan_mutex_);
+    for(std::size_t i = 0; matcher.search(records, name, i); ++i){
+        DetectionPtr detection = cycle_->detection_pool().get();
+        fill_detection(records[i], name, scan_done, pose_sampler_.map_frame,
+                       *pose_history_, cycle_->rssi_filter(), *detection);
+        detection->cached = true;
+        detection_pub_.publish(detection);
+        cached_detections_.push_back(detection);
+    }
+    ROS_INFO("%zu cached detections of %zu networks in the kernel scan cache",
+             cached_detections_.size(), records.size());
+}
+
+
+/// everything that is not needed for the first detections: tf, the map,
+/// the links to the base station, the scan_now threads and the other topics
+void Detector::setup()
+{
+    // the listener fills its buffer from now on, poses are sampled from it
+    double pose_rate;
+    pn_.param("pose_rate", pose_rate, 50.0);
+    tf_listener_.reset(new tf::TransformListener());
+    pose_sampler_.listener = tf_listener_.get();
+    ros::NodeHandle pose_nh(n_);
+    pose_nh.setCallbackQueue(&pose_queue_);
+    pose_timer_ = pose_nh.createTimer(ros::Duration(1.0 / pose_rate), &PoseSampler::sample, &pose_sampler_);
+
+    if(cycle_->params().map_aware){
+        map_sub_ = n_.subscribe("map", 1, &MapListener::on_map, &map_listener_);
+        map_update_sub_ = n_.subscribe("map_updates", 10, &MapListener::on_update, &map_listener_);
+    }
+
+    // detections for the base station over a plain udp link, batched for
+    // up to udp_bridge_period seconds; off unless udp_bridge_host is set.
+    // The decoder counts lost batches per sender, robots need their own
+    std::string bridge_host;
+    int bridge_port, bridge_sender, bridge_max_records;
+    pn_.param<std::string>("udp_bridge_host", bridge_host, "");
+    pn_.param("udp_bridge_port", bridge_port, 5600);
+    if(!pn_.getParam("udp_bridge_sender", bridge_sender)){
+        bridge_sender = default_bridge_sender();
+        if(!bridge_host.empty()){
+            ROS_WARN("udp_bridge_sender not set, sending as %d from the host name", bridge_sender);
+        }
+    }
+    pn_.param("udp_bridge_period", bridge_period_, 1.0);
+    pn_.param("udp_bridge_max_records", bridge_max_records, 24);
+
+    bridge_encoder_.reset(new DetectionBatchEncoder((uint16_t)bridge_sender, bridge_max_records));
+    bridge_sent_ = ros::WallTime::now();
+    if(!bridge_host.empty() && bridge_.open_sender(bridge_host.c_str(), (uint16_t)bridge_port) == 0){
+        ROS_INFO("sending detections to %s:%d", bridge_host.c_str(), bridge_port);
+    }
+
+    // store and forward: detections are queued on disk and forwarded on
+    // wifiDetectionForwarded (and the udp bridge) strongest first while the
+    // base station heartbeat is heard, at most forward_rate per second
+    bool forward_enabled;
+    std::string forward_filename, heartbeat_topic;
+    int forward_size;
+    double forward_rate, forward_burst;
+    pn_.param("forward_queue", forward_enabled, false);
+    pn_.param<std::string>("forward_queue_file", forward_filename, "detection_queue.bin");
+    pn_.param("forward_queue_size", forward_size, 1 << 20);
+    pn_.param<std::string>("link_heartbeat_topic", heartbeat_topic, "base_heartbeat");
+    pn_.param("link_timeout", link_.timeout, 3.0);
+    pn_.param("forward_rate", forward_rate, 5.0);
+    pn_.param("forward_burst", forward_burst, 20.0);
+
+    forward_bucket_.reset(new TokenBucket(forward_rate, forward_burst));
+    if(forward_enabled && forward_queue_.open(forward_filename.c_str(), (std::size_t)forward_size) == 0){
+        ROS_INFO("%zu detections pending in %s", forward_queue_.pending(), forward_filename.c_str());
+        if(heartbeat_topic.empty()){
+            link_.timeout = INFINITY;   // no heartbeat, the link is assumed up
+        }
+        else{
+            heartbeat_sub_ = n_.subscribe(heartbeat_topic, 1, &LinkMonitor::on_heartbeat, &link_);
+        }
+    }
+
+    // scan_now requests wait for a scan on these
+    {
+        std::lock_guard<std::mutex> lock(scan_now_threads_mutex_);
+        for(std::size_t i = 0; i < 2 && i < scan_now_max_threads_; ++i){
+            scan_now_threads_.push_back(std::thread(&Detector::serve_scan_now, this));
+            ++scan_now_idle_;
+        }
+    }
+
+    advertise_outputs();
+}
+
+
+/// connections are served by the service threads, the scan thread may be in its first scan
+void Detector::advertise_detections(int queue_size)
+{
+    ros::AdvertiseOptions options = ros::AdvertiseOptions::create<Detection>(
+        "wifiDetection", queue_size, boost::bind(&Detector::on_detection_subscriber, this, _1),
+        ros::SubscriberStatusCallback(), ros::VoidConstPtr(), &service_queue_);
+    detection_pub_ = n_.advertise(options);
+}
+
+
+/// topics and services of setup()
+void Detector::advertise_outputs()
+{
+    estimate_pub_ = n_.advertise<PhoneEstimate>("phoneEstimate", 100);
+    approach_pub_ = n_.advertise<ClosestApproach>("phoneClosestApproach", 100);
+    if(cycle_->params().summary){
+        summary_pub_ = n_.advertise<ObservationSummary>("observation_summary", 10);
+    }
+    if(forward_queue_.is_open()){
+        forward_pub_ = n_.advertise<Detection>("wifiDetectionForwarded", 100);
+    }
+
+    ros::NodeHandle service_nh(n_);
+    service_nh.setCallbackQueue(&scan_now_queue_);
+    scan_now_srv_ = service_nh.advertiseService("scan_now", &Detector::on_scan_now, this);
+}
+
+
+/// a subscriber that missed the cached detections gets them until the first scan is done
+void Detector::on_detection_subscriber(const ros::SingleSubscriberPublisher& pub)
+{
+    std::lock_guard<std::mutex> lock(scan_mutex_);
+    for(std::size_t i = 0; i < cached_detections_.size(); ++i){
+        pub.publish(*cached_detections_[i]);
+    }
+}
+
+
+void Detector::on_diagnostics_timer(const ros::WallTimerEvent&)
+{
+    diagnostics_->update();
+}
+
+
+void Detector::on_trace_timer(const ros::WallTimerEvent&)
+{
+    trace_->flush();
+    if(trace_->dropped() > 0){
+        ROS_WARN_THROTTLE(60.0, "%llu trace spans dropped, increase trace_buffer_size",
+                          (unsigned long long)trace_->dropped());
+    }
+}
+
+
+void Detector::mark_stage(int stage, uint64_t& last)
+{
+    uint64_t now = monotonic_ns();
+    if(latency_){
+        latency_[stage].record(now - last);
+    }
+    if(trace_){
+        trace_->record(kStageNames[stage], last, now);
+    }
+    if(perf_ && stage != kCycleStage){
+        perf_->mark(stage);
+    }
+    last = now;
+}
+
+
+void Detector::diagnose_cost(diagnostic_updater::DiagnosticStatusWrapper& stat)
+{
+    uint64_t scans = perf_->samples(kPublishStage);
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::OK, "%llu scans", (unsigned long long)scans);
+
+    ros::WallTime now = ros::WallTime::now();
+    double elapsed = (now - perf_reported_time_).toSec();
+    perf_reported_time_ = now;
+
+    for(int c = 0; c < kPerfCounters; ++c){
+        if(!perf_->available(c)){
+            continue;
+        }
+
+        // whole pipeline per second since the previous report
+        uint64_t total = 0;
+        for(int s = 0; s < kCycleStage; ++s){
+            total += perf_->total(s, c);
+        }
+        double rate = elapsed > 0.0 ? (total - perf_reported_[c]) / elapsed : 0.0;
+        perf_reported_[c] = total;
+        if(c == kTaskClock){
+            stat.addf("cpu (%)", "%.1f", rate * 1e-7);
+        }
+        else{
+            stat.addf(std::string(PerfCounters::name(c)) + " (/s)", "%.1f", rate);
+        }
+
+        // average cost of each stage per scan
+        for(int s = 0; s < kCycleStage; ++s){
+            uint64_t n = perf_->samples(s);
+            double mean = n > 0 ? (double)perf_->total(s, c) / n : 0.0;
+            if(c == kTaskClock){
+                stat.addf(std::string(kStageNames[s]) + " cpu (ms/scan)", "%.3f", mean * 1e-6);
+            }
+            else{
+                stat.addf(std::string(kStageNames[s]) + " " + PerfCounters::name(c) + " (/scan)", "%.1f", mean);
+            }
+        }
+    }
+}
+
+
+void Detector::diagnose_latency(diagnostic_updater::DiagnosticStatusWrapper& stat)
+{
+    uint64_t cycles = latency_[kCycleStage].count();
+    if(cycles == 0){
+        stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "no scan completed yet");
+    }
+    else{
+        stat.summaryf(diagnostic_msgs::DiagnosticStatus::OK, "%llu scans", (unsigned long long)cycles);
+    }
+
+    for(int i = 0; i < kStages; ++i){
+        const LatencyHistogram& h = latency_[i];
+        stat.addf(std::string(kStageNames[i]) + " p50 (ms)", "%.3f", h.percentile(0.5) * 1e-6);
+        stat.addf(std::string(kStageNames[i]) + " p99 (ms)", "%.3f", h.percentile(0.99) * 1e-6);
+        stat.addf(std::string(kStageNames[i]) + " max (ms)", "%.3f", h.max() * 1e-6);
+    }
+}
+
+
+void Detector::on_reconfigure(DetectorConfig& config, uint32_t)
+{
+    // callbacks are serialized by the server, only the scan thread reads concurrently
+    std::shared_ptr<const ScanConfig> current = std::atomic_load(&config_);
+
+    // an empty target is in every ssid, every network around would be a phone
+    if(config.target_ssid.empty()){
+        ROS_WARN("ignoring empty target_ssid, still searching for %s", current->matcher->target().c_str());
+        config.target_ssid = current->matcher->target();
+    }
+    std::atomic_store(&config_, make_scan_config(current, config.target_ssid, wifiname_,
+                                                 config.ssid_filename, config.loop_rate,
+                                                 config.queue_size));
+}
+
+
+void Detector::apply_config()
+{
+    std::shared_ptr<const ScanConfig> config = std::atomic_load(&config_);
+    if(config == active_config_){
+        return;
+    }
+
+    // a publisher keeps its queue size, advertise again to change it
+    if(config->queue_size != active_config_->queue_size){
+        chatter_pub_.shutdown();
+        detection_pub_.shutdown();
+        chatter_pub_ = n_.advertise<std_msgs::String>("wifiAvailable", config->queue_size);
+        advertise_detections(config->queue_size);
+    }
+    if(config->loop_rate != active_config_->loop_rate){
+        loop_rate_ = ros::Rate(config->loop_rate);
+    }
+    if(config->matcher != active_config_->matcher){
+        ROS_INFO("searching for %s", config->matcher->target().c_str());
+    }
+    if(config->plan != active_config_->plan){
+        backend_->configure(*config);
+    }
+    active_config_ = config;
+}
+
+
+void Detector::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(scan_mutex_);
+        stopped_ = true;
+    }
+    scan_cond_.notify_all();
+}
+
+
+void Detector::run()
+{
+    // counters follow the thread that opens them
+    if(perf_ && perf_->open() != 0){
+        ROS_WARN("no performance counters available, perf_counters reports nothing");
+    }
+
+    while(ros::ok() && !stopped_ && !backend_->finished()){
+        if(!continuous_scan_){
+            // idle until a scan is requested, serving the subscriptions meanwhile
+            bool requested;
+            {
+                std::unique_lock<std::mutex> lock(scan_mutex_);
+                if(!scan_requested_ && !stopped_){
+                    scan_cond_.wait_for(lock, std::chrono::milliseconds(100));
+                }
+                requested = scan_requested_ && !stopped_;
+            }
+            if(!requested){
+                queue_.callAvailable();
+                continue;
+            }
+        }
+
+        spin_once();
+        if(continuous_scan_ && !backend_->paced()){
+            loop_rate_.sleep();
+        }
+    }
+
+    if(backend_->finished()){
+        ROS_INFO("end of the scan recording");
+        stop();
+    }
+}
+
+
+/// one scan_now thread, takes requests until the detector is destroyed
+void Detector::serve_scan_now()
+{
+    for(;;){
+        {
+            std::lock_guard<std::mutex> lock(scan_now_threads_mutex_);
+            if(scan_now_quit_){
+                return;
+            }
+        }
+        scan_now_queue_.callOne(ros::WallDuration(0.1));
+    }
+}
+
+
+bool Detector::on_scan_now(ScanNow::Request& request, ScanNow::Response& response)
+{
+    TraceSpan span(trace_.get(), "scan_now");
+
+    // the next request must not queue behind this one, keep a thread idle
+    // while there are fewer than scan_now_max_threads
+    struct Busy
+    {
+        Detector* detector;
+        explicit Busy(Detector* d) : detector(d)
+        {
+            std::lock_guard<std::mutex> lock(detector->scan_now_threads_mutex_);
+            if(--detector->scan_now_idle_ == 0 && !detector->scan_now_quit_
+               && detector->scan_now_threads_.size() < detector->scan_now_max_threads_){
+                detector->scan_now_threads_.push_back(std::thread(&Detector::serve_scan_now, detector));
+                ++detector->scan_now_idle_;
+            }
+        }
+        ~Busy()
+        {
+            std::lock_guard<std::mutex> lock(detector->scan_now_threads_mutex_);
+            ++detector->scan_now_idle_;
+        }
+    } busy(this);
+    double timeout = request.timeout > 0.0f ? request.timeout : scan_timeout_;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+        + std::chrono::microseconds((int64_t)(timeout * 1e6));
+
+    std::unique_lock<std::mutex> lock(scan_mutex_);
+
+    // a scan in flight serves this request too, otherwise the next one does
+    uint64_t wanted = scanning_ ? scans_started_ : scans_started_ + 1;
+    if(!scanning_){
+        scan_requested_ = true;
+        scan_cond_.notify_all();
+    }
+
+    while(scans_done_ < wanted && !stopped_){
+        if(scan_cond_.wait_until(lock, deadline) == std::cv_status::timeout){
+            break;
+        }
+    }
+
+    if(scans_done_ < wanted){
+        response.success = false;
+        response.message = stopped_ ? "detector stopped" : "no scan completed before the deadline";
+        return true;
+    }
+
+    response.success = true;
+    response.scan_done = last_scan_done_;
+    response.detections.reserve(last_detections_.size());
+    for(std::size_t i = 0; i < last_detections_.size(); ++i){
+        response.detections.push_back(*last_detections_[i]);
+    }
+    return true;
+}
+
+
+void Detector::spin_once()
+{
+    apply_config();
+    const TargetMatcher& matcher = *active_config_->matcher;
+
+    {
+        std::lock_guard<std::mutex> lock(scan_mutex_);
+        scanning_ = true;
+        scan_requested_ = false;
+        ++scans_started_;
+    }
+
+    // stage timestamps, only taken with latency_stats or a trace
+    timed_ = latency_ || trace_ || perf_;
+    uint64_t cycle_start = timed_ ? monotonic_ns() : 0;
+    stage_start_ = cycle_start;
+    if(perf_){
+        perf_->start();
+    }
+
+    // scan for a list of available wifi networks
+    ros::Time scan_done;
+    if(backend_->scan(scan_done) != 0){
+        scan_done = ros::Time::now();
+    }
+    if(timed_){
+        mark_stage(kScanStage, stage_start_);
+    }
+
+    backend_->read(cycle_->records());
+    if(scan_recorder_){
+        scan_recorder_->append(scan_done.toNSec(), cycle_->records());
+    }
+    if(timed_){
+        mark_stage(kParseStage, stage_start_);
+    }
+
+    // the detections are published by the on_*() callbacks as they are made
+    cycle_->run(scan_done, matcher, *this);
+
+    if(cycle_->calibration_dirty() && (ros::WallTime::now() - calibration_saved_).toSec() > 10.0){
+        cycle_->save_calibration(calibration_filename_.c_str());
+        calibration_saved_ = ros::WallTime::now();
+    }
+    if(cycle_->params().learn_ambient && cycle_->ambient_dirty()
+       && (ros::WallTime::now() - ambient_saved_).toSec() > 10.0){
+        cycle_->save_ambient(ambient_filename_.c_str());
+        ambient_saved_ = ros::WallTime::now();
+    }
+
+    // hand the result to the scan_now requests waiting for this scan
+    {
+        std::lock_guard<std::mutex> lock(scan_mutex_);
+        last_detections_.swap(cycle_->detections());
+        cached_detections_.clear();
+        last_scan_done_ = scan_done;
+        scanning_ = false;
+        ++scans_done_;
+    }
+    scan_cond_.notify_all();
+
+    publish_periodic();
+
+    const std_msgs::StringPtr& msg = cycle_->chatter();
+    ROS_INFO("%s", msg->data.c_str());
+    chatter_pub_.publish(msg);
+
+    uint64_t misses = cycle_->pool_misses();
+    if(misses != pool_misses_){
+        pool_misses_ = misses;
+        ROS_WARN("message pools ran out %llu times, raise message_pool_size",
+                 (unsigned long long)misses);
+    }
+    if(timed_){
+        mark_stage(kPublishStage, stage_start_);
+        mark_stage(kCycleStage, cycle_start);
+    }
+
+    TraceSpan span(trace_.get(), "callbacks");
+    queue_.callAvailable();
+}
+
+
+void Detector::on_matched()
+{
+    if(timed_){
+        mark_stage(kMatchStage, stage_start_);
+    }
+}
+
+
+void Detector::on_detection(const DetectionConstPtr& detection_ptr, const BssRecord& bss)
+{
+    detection_pub_.publish(detection_ptr);
+    const Detection& detection = *detection_ptr;
+
+    if(bridge_.is_open() || forward_queue_.is_open()){
+        // cached beacons come back unchanged, only new sightings are sent
+        double t = detection.header.stamp.toSec();
+        std::map<uint64_t, double>::iterator it = bridge_last_time_.find(bss.bssid);
+        if(it == bridge_last_time_.end() || t > it->second){
+            bridge_last_time_[bss.bssid] = t;
+            DetectionReport report;
+            fill_report(detection, bss, report);
+            if(forward_queue_.is_open()){
+                forward_queue_.push(report, detection.ssid);
+            }
+            else{
+                send_report(report);
+            }
+        }
+    }
+}
+
+
+/// adds a report to the udp bridge batch, sending the batch first when it is full
+void Detector::send_report(const DetectionReport& report)
+{
+    if(bridge_encoder_->add(report)){
+        return;
+    }
+    bridge_encoder_->take(bridge_batch_);
+    bridge_.send(bridge_batch_.data(), bridge_batch_.size());
+    bridge_sent_ = ros::WallTime::now();
+    if(!bridge_encoder_->add(report)){
+        char bssid_text[18];
+        format_bssid(report.bssid, bssid_text);
+        ROS_WARN_THROTTLE(10.0, "not sending the detection of %s at %.3f s, before the epoch",
+                          bssid_text, report.t);
+    }
+}
+
+
+void Detector::on_closest_approach(const ClosestApproachConstPtr& approach)
+{
+    approach_pub_.publish(approach);
+    ROS_INFO("passed closest to %s at (%.1f, %.1f, %.1f), %.1f dBm", approach->ssid.c_str(),
+             approach->robot_pose.position.x, approach->robot_pose.position.y,
+             approach->robot_pose.position.z, approach->rssi_peak);
+}
+
+
+void Detector::on_estimate(const PhoneEstimateConstPtr& estimate)
+{
+    estimate_pub_.publish(estimate);
+}
+
+
+void Detector::publish_periodic()
+{
+    TraceSpan span(trace_.get(), "periodic");
+
+    // only tiles that changed since the last publish are sent
+    if(cycle_->params().heatmap && (ros::WallTime::now() - heatmap_published_).toSec() >= 1.0 / heatmap_rate_){
+        heatmap_published_ = ros::WallTime::now();
+        std::map<uint64_t, TargetHeatmap>& heatmaps = cycle_->heatmaps();
+        for(std::map<uint64_t, TargetHeatmap>::iterator it = heatmaps.begin(); it != heatmaps.end(); ++it){
+            it->second.map.take_dirty(heatmap_tiles_);
+            if(heatmap_tiles_.empty()){
+                continue;
+            }
+
+            ros::Publisher& pub = heatmap_pubs_[it->first];
+            if(!pub){
+                // one topic per target, e.g. rssi_heatmap/AABBCCDDEEFF
+                char bssid_text[18];
+                format_bssid(it->first, bssid_text);
+                std::string topic = std::string("rssi_heatmap/") + bssid_text;
+                topic.erase(std::remove(topic.begin(), topic.end(), ':'), topic.end());
+                pub = n_.advertise<nav_msgs::OccupancyGrid>(topic, 100);
+            }
+            for(std::size_t i = 0; i < heatmap_tiles_.size(); ++i){
+                nav_msgs::OccupancyGridPtr grid(new nav_msgs::OccupancyGrid);
+                fill_heatmap_tile(it->second.map, *heatmap_tiles_[i], pose_sampler_.map_frame,
+                                  heatmap_min_dbm_, heatmap_max_dbm_, *grid);
+                pub.publish(grid);
+            }
+        }
+    }
+
+    if(forward_queue_.is_open()){
+        forward_queue_.sync();
+
+        // forwarding is best effort, a detection counts as delivered once sent with the link up
+        QueuedDetection queued;
+        double now = ros::WallTime::now().toSec();
+        while(link_.up() && forward_queue_.front(queued) && forward_bucket_->take(now)){
+            DetectionPtr forwarded = cycle_->detection_pool().get();
+            // entries of a queue written before names were kept only have the target
+            fill_forwarded(queued.report, queued.ssid.empty() ? active_config_->matcher->target() : queued.ssid,
+                           pose_sampler_.map_frame, *forwarded);
+            forward_pub_.publish(forwarded);
+            if(bridge_.is_open()){
+                send_report(queued.report);
+            }
+            forward_queue_.acknowledge(queued.sequence);
+        }
+    }
+
+    if(bridge_.is_open() && !bridge_encoder_->empty()
+       && (ros::WallTime::now() - bridge_sent_).toSec() >= bridge_period_){
+        bridge_encoder_->take(bridge_batch_);
+        bridge_.send(bridge_batch_.data(), bridge_batch_.size());
+        bridge_sent_ = ros::WallTime::now();
+    }
+
+    // a lost delta is repaired by the next full summary
+    if(cycle_->params().summary && (ros::WallTime::now() - summary_published_).toSec() >= 1.0 / summary_rate_){
+        summary_published_ = ros::WallTime::now();
+        SummaryStore& store = cycle_->summary_store();
+        bool full = summary_full_every_ > 0 && summaries_sent_ % summary_full_every_ == 0;
+        store.take_changes(full, summary_entries_);
+        if(!summary_entries_.empty()){
+            ObservationSummaryPtr summary(new ObservationSummary);
+            fill_summary(summary_entries_, cycle_->summary_ssids(), *summary);
+            summary->header.stamp = ros::Time::now();
+            summary->header.frame_id = pose_sampler_.map_frame;
+            summary->robot_id = robot_id_;
+            summary->incarnation = summary_incarnation_;
+            summary->voxel_size = store.voxel_size();
+            summary->z_voxel_size = store.z_voxel_size();
+            summary->full = full;
+            summary_pub_.publish(summary);
+            ++summaries_sent_;
+        }
+    }
+}
+
+} // namespace detectssid
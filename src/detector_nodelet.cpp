@@ -0,0 +1,55 @@
+/** Phone network detector as a nodelet
+ *
+ *  Purpose: run the detector in the same process as the localization and
+ *  report nodelets, which then receive its messages without
+ *  serialization. Same topics and parameters as the detectssid node.
+ *
+ */
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include "nodelet/nodelet.h"
+#include "pluginlib/class_list_macros.h"
+
+#include "detectssid/detector.h"
+
+namespace detectssid
+{
+
+/**
+ * @brief Runs a Detector inside a nodelet manager
+ *
+ * A scan blocks for seconds, so the detector runs on its own thread
+ * instead of the manager's callback threads.
+ */
+class DetectorNodelet : public nodelet::Nodelet
+{
+public:
+    ~DetectorNodelet()
+    {
+        if(detector_){
+            detector_->stop();
+        }
+        if(thread_.joinable()){
+            thread_.join();
+        }
+    }
+
+private:
+    void onInit()
+    {
+        detector_.reset(new Detector(getNodeHandle(), getPrivateNodeHandle()));
+        if(detector_->init() != 0){
+            NODELET_ERROR("could not open the scan backend, not scanning");
+            return;
+        }
+        thread_ = boost::thread(&Detector::run, detector_.get());
+    }
+
+    boost::shared_ptr<Detector> detector_;
+    boost::thread thread_;
+};
+
+} // namespace detectssid
+
+PLUGINLIB_EXPORT_CLASS(detectssid::DetectorNodelet, nodelet::Nodelet)
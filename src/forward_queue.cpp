@@ -0,0 +1,375 @@
+/** Persistent store and forward queue of detections
+ */
+
+#include "detectssid/forward_queue.h"
+#include "detectssid/bss.h"
+#include "detectssid/byte_order.h"
+#include "detectssid/crc32.h"
+
+#include <cerrno>
+#include <cmath>            // isnan, INFINITY
+#include <cstdio>           // fprintf, snprintf, rename
+#include <cstring>          // memcpy, memcmp, memset, strerror
+#include <fcntl.h>          // open
+#include <sys/mman.h>       // mmap, msync
+#include <sys/stat.h>       // fstat
+#include <unistd.h>         // ftruncate, close
+#include <vector>
+
+namespace detectssid
+{
+
+namespace
+{
+
+const char kMagic[8] = { 'D', 'S', 'S', 'I', 'D', 'F', 'Q', '1' };
+const std::size_t kHeaderSize = 16;
+const std::size_t kEntryHeaderSize = 16;
+const std::size_t kDetectionPayload = 8 + kRecordSize;          // without a name
+const std::size_t kMaxDetectionPayload = kDetectionPayload + 1 + kMaxSsidText;
+const uint8_t kDetection = 1;
+const uint8_t kAcknowledge = 2;
+
+/// strongest sighting first; detections without a level go last
+float priority(const DetectionReport& report)
+{
+    if(!std::isnan(report.rssi_smoothed)){
+        return report.rssi_smoothed;
+    }
+    return std::isnan(report.rssi) ? -INFINITY : report.rssi;
+}
+
+/// serializes one entry into out, returns its size
+std::size_t encode_entry(uint8_t type, uint64_t sequence, const uint8_t* payload, std::size_t len, uint8_t* out)
+{
+    put_le(out + 4, len, 2);
+    out[6] = type;
+    out[7] = 0;
+    put_le(out + 8, sequence, 8);
+    if(len > 0){
+        memcpy(out + kEntryHeaderSize, payload, len);
+    }
+    put_le(out, crc32(out + 4, kEntryHeaderSize - 4 + len), 4);
+    return kEntryHeaderSize + len;
+}
+
+/// serializes a detection payload into payload, kMaxDetectionPayload bytes, returns its size
+std::size_t encode_detection(const DetectionReport& report, const std::string& ssid, uint8_t* payload)
+{
+    uint64_t ms = (uint64_t)(report.t * 1000.0 + 0.5);
+    std::size_t n = ssid.size() < kMaxSsidText ? ssid.size() : kMaxSsidText;
+
+    put_le(payload, ms, 8);
+    encode_detection_record(report, ms, payload + 8);
+    payload[kDetectionPayload] = (uint8_t)n;
+    memcpy(payload + kDetectionPayload + 1, ssid.data(), n);
+    return kDetectionPayload + 1 + n;
+}
+
+/// reads a detection payload of len bytes, false when it is malformed
+bool decode_detection(const uint8_t* payload, std::size_t len, DetectionReport& report, std::string& ssid)
+{
+    if(len == kDetectionPayload){
+        ssid.clear();
+    }
+    else if(len > kDetectionPayload && len == kDetectionPayload + 1 + payload[kDetectionPayload]){
+        ssid.assign((const char*)payload + kDetectionPayload + 1, payload[kDetectionPayload]);
+    }
+    else{
+        return false;
+    }
+    decode_detection_record(payload + 8, get_le(payload, 8), report);
+    return true;
+}
+
+} // namespace
+
+
+ForwardQueue::ForwardQueue()
+    : fd_(-1), base_(NULL), capacity_(0), end_(0), next_sequence_(0)
+{
+}
+
+
+ForwardQueue::~ForwardQueue()
+{
+    close();
+}
+
+
+void ForwardQueue::close()
+{
+    if(base_ != NULL){
+        msync(base_, capacity_, MS_SYNC);
+        munmap(base_, capacity_);
+        base_ = NULL;
+    }
+    if(fd_ >= 0){
+        ::close(fd_);
+        fd_ = -1;
+    }
+    capacity_ = 0;
+    end_ = 0;
+}
+
+
+int ForwardQueue::map_file(const char* filename, std::size_t capacity)
+{
+    fd_ = ::open(filename, O_RDWR | O_CREAT, 0644);
+    if(fd_ < 0){
+        fprintf(stderr, "could not open %s, errno: %s\n", filename, strerror(errno));
+        return -1;
+    }
+
+    // an existing queue keeps its size
+    struct stat st;
+    if(fstat(fd_, &st) != 0){
+        fprintf(stderr, "could not stat %s, errno: %s\n", filename, strerror(errno));
+        close();
+        return -1;
+    }
+    bool created = st.st_size < (off_t)kHeaderSize;
+    capacity_ = created ? capacity : (std::size_t)st.st_size;
+    if(created && ftruncate(fd_, (off_t)capacity_) != 0){
+        fprintf(stderr, "could not size %s, errno: %s\n", filename, strerror(errno));
+        close();
+        return -1;
+    }
+
+    void* p = mmap(NULL, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if(p == MAP_FAILED){
+        fprintf(stderr, "could not map %s, errno: %s\n", filename, strerror(errno));
+        capacity_ = 0;
+        close();
+        return -1;
+    }
+    base_ = (uint8_t*)p;
+
+    if(created){
+        memcpy(base_, kMagic, sizeof(kMagic));
+    }
+    else if(memcmp(base_, kMagic, sizeof(kMagic)) != 0){
+        fprintf(stderr, "%s is not a detection queue\n", filename);
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+
+int ForwardQueue::open(const char* filename, std::size_t capacity)
+{
+    close();
+    pending_.clear();
+    by_bssid_.clear();
+    order_.clear();
+    next_sequence_ = 0;
+
+    if(capacity < kHeaderSize + 64 * (kEntryHeaderSize + kDetectionPayload)){
+        capacity = kHeaderSize + 64 * (kEntryHeaderSize + kDetectionPayload);
+    }
+    filename_ = filename;
+    if(map_file(filename, capacity) != 0){
+        return -1;
+    }
+    replay();
+    return 0;
+}
+
+
+void ForwardQueue::replay()
+{
+    end_ = kHeaderSize;
+    while(end_ + kEntryHeaderSize <= capacity_){
+        const uint8_t* p = base_ + end_;
+        std::size_t len = get_le(p + 4, 2);
+        if(end_ + kEntryHeaderSize + len > capacity_
+           || get_le(p, 4) != crc32(p + 4, kEntryHeaderSize - 4 + len)){
+            break;      // end of the log, or an entry torn by a crash
+        }
+
+        uint8_t type = p[6];
+        uint64_t sequence = get_le(p + 8, 8);
+        DetectionReport report;
+        std::string ssid;
+        if(type == kDetection && decode_detection(p + kEntryHeaderSize, len, report, ssid)){
+            insert(sequence, report, ssid);
+        }
+        else if(type == kAcknowledge){
+            remove(sequence);
+        }
+        if(sequence >= next_sequence_){
+            next_sequence_ = sequence + 1;
+        }
+        end_ += kEntryHeaderSize + len;
+    }
+
+    // whatever follows a torn entry is garbage, clear it so it is never replayed
+    memset(base_ + end_, 0, capacity_ - end_);
+}
+
+
+void ForwardQueue::insert(uint64_t sequence, const DetectionReport& report, const std::string& ssid)
+{
+    std::unordered_map<uint64_t, uint64_t>::iterator it = by_bssid_.find(report.bssid);
+    if(it != by_bssid_.end()){
+        remove(it->second);
+    }
+
+    QueuedDetection& entry = pending_[sequence];
+    entry.sequence = sequence;
+    entry.report = report;
+    entry.ssid = ssid;
+    by_bssid_[report.bssid] = sequence;
+    order_.insert(Rank(-priority(report), sequence));
+}
+
+
+void ForwardQueue::remove(uint64_t sequence)
+{
+    std::map<uint64_t, QueuedDetection>::iterator it = pending_.find(sequence);
+    if(it == pending_.end()){
+        return;
+    }
+    order_.erase(Rank(-priority(it->second.report), sequence));
+    by_bssid_.erase(it->second.report.bssid);
+    pending_.erase(it);
+}
+
+
+int ForwardQueue::append(uint8_t type, uint64_t sequence, const uint8_t* payload, std::size_t len)
+{
+    if(base_ == NULL){
+        return -1;
+    }
+    if(end_ + kEntryHeaderSize + len > capacity_){
+        if(compact() != 0 || end_ + kEntryHeaderSize + len > capacity_){
+            return -1;
+        }
+    }
+
+    end_ += encode_entry(type, sequence, payload, len, base_ + end_);
+    return 0;
+}
+
+
+int ForwardQueue::compact()
+{
+    // the pending detections, oldest first so replay rebuilds the same queue
+    std::vector<uint8_t> image(capacity_, 0);
+    memcpy(&image[0], kMagic, sizeof(kMagic));
+    std::size_t end = kHeaderSize;
+    uint8_t payload[kMaxDetectionPayload];
+    for(std::map<uint64_t, QueuedDetection>::const_iterator it = pending_.begin(); it != pending_.end(); ++it){
+        std::size_t len = encode_detection(it->second.report, it->second.ssid, payload);
+        end += encode_entry(kDetection, it->first, payload, len, &image[end]);
+    }
+
+    // write to a temporary file and rename so a crash never leaves a torn queue
+    char tmpname[4096];
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename_.c_str());
+    FILE* fp = fopen(tmpname, "wb");
+    if(fp == NULL){
+        fprintf(stderr, "could not write %s, errno: %s\n", tmpname, strerror(errno));
+        return -1;
+    }
+    bool ok = fwrite(image.data(), 1, image.size(), fp) == image.size() && fflush(fp) == 0
+           && fsync(fileno(fp)) == 0;
+    if(fclose(fp) != 0 || !ok){
+        fprintf(stderr, "could not write %s\n", tmpname);
+        ::remove(tmpname);
+        return -1;
+    }
+    if(rename(tmpname, filename_.c_str()) != 0){
+        fprintf(stderr, "could not rename %s, errno: %s\n", tmpname, strerror(errno));
+        ::remove(tmpname);
+        return -1;
+    }
+
+    std::size_t capacity = capacity_;
+    close();
+    if(map_file(filename_.c_str(), capacity) != 0){
+        return -1;
+    }
+    end_ = end;
+    return 0;
+}
+
+
+bool ForwardQueue::push(const DetectionReport& report, const std::string& ssid)
+{
+    std::unordered_map<uint64_t, uint64_t>::const_iterator it = by_bssid_.find(report.bssid);
+    if(it != by_bssid_.end() && priority(pending_[it->second].report) > priority(report)){
+        return false;
+    }
+
+    uint8_t payload[kMaxDetectionPayload];
+    std::size_t len = encode_detection(report, ssid, payload);
+    if(append(kDetection, next_sequence_, payload, len) != 0){
+        return false;
+    }
+
+    // keep what replay would rebuild, i.e. the quantized report
+    DetectionReport stored;
+    std::string name;
+    decode_detection(payload, len, stored, name);
+    insert(next_sequence_, stored, name);
+    ++next_sequence_;
+    return true;
+}
+
+
+bool ForwardQueue::front(QueuedDetection& out) const
+{
+    if(order_.empty()){
+        return false;
+    }
+    out = pending_.find(order_.begin()->second)->second;
+    return true;
+}
+
+
+int ForwardQueue::acknowledge(uint64_t sequence)
+{
+    if(pending_.find(sequence) == pending_.end()){
+        return 0;
+    }
+    if(append(kAcknowledge, sequence, NULL, 0) != 0){
+        return -1;
+    }
+    remove(sequence);
+    return 0;
+}
+
+
+void ForwardQueue::sync()
+{
+    if(base_ != NULL){
+        msync(base_, capacity_, MS_ASYNC);
+    }
+}
+
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate_(rate), burst_(burst < 1.0 ? 1.0 : burst), tokens_(burst_), last_(-INFINITY)
+{
+}
+
+
+bool TokenBucket::take(double now)
+{
+    if(now > last_){
+        tokens_ = std::isinf(last_) ? burst_ : tokens_ + (now - last_) * rate_;
+        if(tokens_ > burst_){
+            tokens_ = burst_;
+        }
+        last_ = now;
+    }
+    if(tokens_ < 1.0){
+        return false;
+    }
+    tokens_ -= 1.0;
+    return true;
+}
+
+} // namespace detectssid
@@ -0,0 +1,308 @@
+/** Coarse to fine grid phone localizer
+ *
+ * Sum of squared residuals of a cell with n observations, k = 10 exponent:
+ *
+ *   sum a   = Sy + k Sl
+ *   sum a^2 = Syy + 2 k Syl + k^2 Sll
+ *   SSE     = sum a^2 - 2 P sum a + n P^2         ref_power P given
+ *   SSE     = sum a^2 - (sum a)^2 / n             P fitted, P = sum a / n
+ *
+ */
+
+#include "detectssid/grid_localizer.h"
+
+#include <algorithm>        // partial_sort, find
+#include <cmath>
+#include <cstdio>           // fprintf
+#include <functional>       // greater
+#include <utility>          // pair
+
+namespace detectssid
+{
+
+GridLocalizer::GridLocalizer(const GridLocalizerParams& params)
+    : params_(params), coarse_size_(0), fine_per_coarse_(1), origin_x_(0.0), origin_y_(0.0), origin_z_(0.0),
+      last_time_(-INFINITY), observations_(0), sum_z_(0.0), sum_zz_(0.0), replayable_(true)
+{
+    if(params_.refine_cells < 1){
+        params_.refine_cells = 1;
+    }
+}
+
+
+void GridLocalizer::add(CellSums& cell, double y, double l) const
+{
+    cell.y += y;
+    cell.yy += y * y;
+    cell.l += l;
+    cell.ll += l * l;
+    cell.yl += y * l;
+}
+
+
+double GridLocalizer::log_likelihood(const CellSums& cell) const
+{
+    const double n = (double)observations_;
+    const double k = 10.0 * model_.exponent;
+    double sum_a = cell.y + k * cell.l;
+    double sum_aa = cell.yy + 2.0 * k * cell.yl + k * k * cell.ll;
+    double sse;
+
+    if(params_.fit_ref_power){
+        sse = sum_aa - sum_a * sum_a / n;
+    }
+    else{
+        const double p = model_.ref_power;
+        sse = sum_aa - 2.0 * p * sum_a + n * p * p;
+    }
+    return -0.5 * sse / (model_.sigma * model_.sigma);
+}
+
+
+double GridLocalizer::log_distance(double cx, double cy, const RssiObservation& obs,
+                                   const DistanceField* field) const
+{
+    // as the particle filter: the planar field distance, or the straight line, and the height
+    double dx = cx - obs.x;
+    double dy = cy - obs.y;
+    double dz = origin_z_ - obs.z;
+    double planar = field != NULL ? field->distance(cx, cy) : -1.0;
+    double d = planar >= 0.0 ? std::sqrt(planar * planar + dz * dz)
+                             : std::sqrt(dx * dx + dy * dy + dz * dz);
+    if(d < model_.min_distance){
+        d = model_.min_distance;
+    }
+    return std::log10(d);
+}
+
+
+void GridLocalizer::cell_center(uint32_t coarse_index, uint32_t fine_index, double& x, double& y) const
+{
+    uint32_t cx = coarse_index % coarse_size_;
+    uint32_t cy = coarse_index / coarse_size_;
+    uint32_t fx = fine_index % fine_per_coarse_;
+    uint32_t fy = fine_index / fine_per_coarse_;
+    double fine = params_.coarse_resolution / fine_per_coarse_;
+    x = origin_x_ + cx * params_.coarse_resolution + (fx + 0.5) * fine;
+    y = origin_y_ + cy * params_.coarse_resolution + (fy + 0.5) * fine;
+}
+
+
+bool GridLocalizer::update(const RssiObservation& obs, const PathLossModel& model,
+                           const DistanceField* field)
+{
+    if(obs.t <= last_time_){
+        return false;
+    }
+    last_time_ = obs.t;
+    model_ = model;
+
+    if(coarse_.empty()){
+        coarse_size_ = (uint32_t)std::ceil(2.0 * params_.search_radius / params_.coarse_resolution);
+        if(coarse_size_ < 1){
+            coarse_size_ = 1;
+        }
+        fine_per_coarse_ = (uint32_t)std::ceil(params_.coarse_resolution / params_.fine_resolution - 1e-9);
+        if(fine_per_coarse_ < 1){
+            fine_per_coarse_ = 1;
+        }
+        origin_x_ = obs.x - 0.5 * coarse_size_ * params_.coarse_resolution;
+        origin_y_ = obs.y - 0.5 * coarse_size_ * params_.coarse_resolution;
+        origin_z_ = obs.z;
+        CellSums zero = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+        coarse_.assign((std::size_t)coarse_size_ * coarse_size_, zero);
+    }
+
+    ++observations_;
+    sum_z_ += obs.z;
+    sum_zz_ += obs.z * obs.z;
+    if(replayable_){
+        if(field != NULL){
+            stop_refining("map aware observations cannot be replayed");
+        }
+        else if(history_.size() >= params_.max_history){
+            stop_refining("the observation history is full");
+        }
+        else{
+            history_.push_back(obs);
+        }
+    }
+
+    // coarse cells, centers on a regular lattice
+    double half = 0.5 * params_.coarse_resolution;
+    for(uint32_t cy = 0; cy < coarse_size_; ++cy){
+        double y = origin_y_ + cy * params_.coarse_resolution + half;
+        CellSums* row = &coarse_[(std::size_t)cy * coarse_size_];
+        for(uint32_t cx = 0; cx < coarse_size_; ++cx){
+            double x = origin_x_ + cx * params_.coarse_resolution + half;
+            add(row[cx], obs.rssi, log_distance(x, y, obs, field));
+        }
+    }
+
+    // fine blocks that already exist
+    for(std::size_t b = 0; b < blocks_.size(); ++b){
+        FineBlock& block = blocks_[b];
+        for(uint32_t f = 0; f < block.cells.size(); ++f){
+            double x, y;
+            cell_center(block.coarse_index, f, x, y);
+            add(block.cells[f], obs.rssi, log_distance(x, y, obs, field));
+        }
+    }
+
+    refine();
+    return true;
+}
+
+
+void GridLocalizer::stop_refining(const char* reason)
+{
+    fprintf(stderr, "grid localizer: %s, keeping the %zu fine blocks made so far\n", reason, blocks_.size());
+    replayable_ = false;
+    std::vector<RssiObservation>().swap(history_);
+}
+
+
+const GridLocalizer::FineBlock* GridLocalizer::find_block(uint32_t coarse_index) const
+{
+    for(std::size_t b = 0; b < blocks_.size(); ++b){
+        if(blocks_[b].coarse_index == coarse_index){
+            return &blocks_[b];
+        }
+    }
+    return NULL;
+}
+
+
+void GridLocalizer::fill_block(FineBlock& block) const
+{
+    CellSums zero = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+    block.cells.assign((std::size_t)fine_per_coarse_ * fine_per_coarse_, zero);
+
+    for(uint32_t f = 0; f < block.cells.size(); ++f){
+        double x, y;
+        cell_center(block.coarse_index, f, x, y);
+        for(std::size_t i = 0; i < history_.size(); ++i){
+            add(block.cells[f], history_[i].rssi, log_distance(x, y, history_[i], NULL));
+        }
+    }
+}
+
+
+void GridLocalizer::refine()
+{
+    // rank coarse cells, only the best refine_cells need to be ordered
+    ranking_.resize(coarse_.size());
+    for(uint32_t i = 0; i < coarse_.size(); ++i){
+        ranking_[i] = std::make_pair(log_likelihood(coarse_[i]), i);
+    }
+    std::size_t k = std::min(params_.refine_cells, ranking_.size());
+    std::partial_sort(ranking_.begin(), ranking_.begin() + k, ranking_.end(),
+                      std::greater<std::pair<double, uint32_t> >());
+
+    top_.resize(k);
+    for(std::size_t i = 0; i < k; ++i){
+        top_[i] = ranking_[i].second;
+    }
+
+    // blocks can no longer be filled, keep all of them
+    if(!replayable_){
+        return;
+    }
+
+    // drop blocks that left the top cells, keeping a few as hysteresis
+    std::size_t keep = 2 * k;
+    for(std::size_t b = 0; b < blocks_.size() && blocks_.size() > keep; ){
+        if(std::find(top_.begin(), top_.end(), blocks_[b].coarse_index) == top_.end()){
+            blocks_[b] = blocks_.back();
+            blocks_.pop_back();
+        }
+        else{
+            ++b;
+        }
+    }
+
+    for(std::size_t i = 0; i < k; ++i){
+        if(find_block(top_[i]) == NULL){
+            blocks_.push_back(FineBlock());
+            blocks_.back().coarse_index = top_[i];
+            fill_block(blocks_.back());
+        }
+    }
+}
+
+
+void GridLocalizer::estimate(PositionEstimate& out) const
+{
+    out.x = out.y = out.z = 0.0;
+    for(int i = 0; i < 9; ++i){
+        out.cov[i] = 0.0;
+    }
+    out.observations = observations_;
+    if(observations_ == 0){
+        return;
+    }
+
+    // likelihood weights over the fine cells of the top coarse cells, a top cell
+    // without a block counts as fine_per_coarse^2 fine cells at its center
+    const double fine = params_.coarse_resolution / fine_per_coarse_;
+    const double coarse_area = std::log((double)fine_per_coarse_ * fine_per_coarse_);
+    double best = -INFINITY;
+    for(std::size_t i = 0; i < top_.size(); ++i){
+        const FineBlock* block = find_block(top_[i]);
+        if(block == NULL){
+            best = std::max(best, log_likelihood(coarse_[top_[i]]) + coarse_area);
+            continue;
+        }
+        for(std::size_t f = 0; f < block->cells.size(); ++f){
+            best = std::max(best, log_likelihood(block->cells[f]));
+        }
+    }
+
+    // cell size adds a uniform quantization variance
+    double sw = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, syy = 0.0, sxy = 0.0, sq = 0.0;
+    for(std::size_t i = 0; i < top_.size(); ++i){
+        const FineBlock* block = find_block(top_[i]);
+        if(block == NULL){
+            double w = std::exp(log_likelihood(coarse_[top_[i]]) + coarse_area - best);
+            double half = 0.5 * params_.coarse_resolution;
+            double x = origin_x_ + (top_[i] % coarse_size_) * params_.coarse_resolution + half;
+            double y = origin_y_ + (top_[i] / coarse_size_) * params_.coarse_resolution + half;
+            sw += w;
+            sx += w * x;
+            sy += w * y;
+            sxx += w * x * x;
+            syy += w * y * y;
+            sxy += w * x * y;
+            sq += w * params_.coarse_resolution * params_.coarse_resolution / 12.0;
+            continue;
+        }
+        for(uint32_t f = 0; f < block->cells.size(); ++f){
+            double w = std::exp(log_likelihood(block->cells[f]) - best);
+            double x, y;
+            cell_center(block->coarse_index, f, x, y);
+            sw += w;
+            sx += w * x;
+            sy += w * y;
+            sxx += w * x * x;
+            syy += w * y * y;
+            sxy += w * x * y;
+            sq += w * fine * fine / 12.0;
+        }
+    }
+    if(!(sw > 0.0)){
+        return;
+    }
+
+    double quantization = sq / sw;
+    double n = (double)observations_;
+
+    out.x = sx / sw;
+    out.y = sy / sw;
+    out.z = origin_z_;
+    out.cov[0] = sxx / sw - out.x * out.x + quantization;
+    out.cov[4] = syy / sw - out.y * out.y + quantization;
+    out.cov[1] = out.cov[3] = sxy / sw - out.x * out.y;
+    out.cov[8] = std::max(sum_zz_ / n - 2.0 * out.z * sum_z_ / n + out.z * out.z, 0.0) + 1.0;
+}
+
+} // namespace detectssid
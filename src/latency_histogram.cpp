@@ -0,0 +1,94 @@
+/** Latency histogram
+ */
+
+#include "detectssid/latency_histogram.h"
+
+#include <time.h>           // clock_gettime
+
+namespace detectssid
+{
+
+uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+LatencyHistogram::LatencyHistogram()
+    : count_(0), max_(0)
+{
+    for(int i = 0; i < kBuckets; ++i){
+        counts_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+
+int LatencyHistogram::bucket(uint64_t ns)
+{
+    if(ns < (uint64_t)kLinearBuckets){
+        return (int)ns;
+    }
+
+    // exponent and the 5 bits below the leading one
+    int e = 63 - __builtin_clzll(ns);
+    if(e > kMaxExponent){
+        return kBuckets - 1;
+    }
+    int top = (int)(ns >> (e - 5));
+    return kLinearBuckets + (e - 6) * kSubBuckets + (top - kSubBuckets);
+}
+
+
+uint64_t LatencyHistogram::bucket_end(int index)
+{
+    if(index < kLinearBuckets){
+        return (uint64_t)index;
+    }
+    int k = index - kLinearBuckets;
+    int e = 6 + k / kSubBuckets;
+    uint64_t top = kSubBuckets + k % kSubBuckets;
+    return ((top + 1) << (e - 5)) - 1;
+}
+
+
+void LatencyHistogram::record(uint64_t ns)
+{
+    counts_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t current = max_.load(std::memory_order_relaxed);
+    while(ns > current && !max_.compare_exchange_weak(current, ns, std::memory_order_relaxed)){
+    }
+}
+
+
+uint64_t LatencyHistogram::percentile(double q) const
+{
+    // buckets are read one at a time, a value recorded meanwhile may or may not be counted
+    uint64_t total = 0;
+    for(int i = 0; i < kBuckets; ++i){
+        total += counts_[i].load(std::memory_order_relaxed);
+    }
+    if(total == 0){
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(q * (double)total + 0.5);
+    if(rank < 1){
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for(int i = 0; i < kBuckets; ++i){
+        seen += counts_[i].load(std::memory_order_relaxed);
+        if(seen >= rank){
+            uint64_t end = bucket_end(i);
+            uint64_t largest = max();
+            return end < largest ? end : largest;
+        }
+    }
+    return max();
+}
+
+} // namespace detectssid
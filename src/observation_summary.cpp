@@ -0,0 +1,147 @@
+/** Mergeable observation summaries
+ */
+
+#include "detectssid/observation_summary.h"
+
+#include <cmath>            // floor, isnan, INFINITY
+
+namespace detectssid
+{
+
+VoxelStatistics::VoxelStatistics()
+    : count(0), sum(0.0), sum_sq(0.0), max(-INFINITY)
+{
+}
+
+
+void VoxelStatistics::add(float rssi)
+{
+    ++count;
+    sum += rssi;
+    sum_sq += (double)rssi * rssi;
+    if(rssi > max){
+        max = rssi;
+    }
+}
+
+
+bool VoxelStatistics::merge(const VoxelStatistics& other)
+{
+    if(other.count <= count){
+        return false;
+    }
+    *this = other;
+    return true;
+}
+
+
+void VoxelStatistics::accumulate(const VoxelStatistics& other)
+{
+    count += other.count;
+    sum += other.sum;
+    sum_sq += other.sum_sq;
+    if(other.max > max){
+        max = other.max;
+    }
+}
+
+
+SummaryStore::SummaryStore(double voxel_size, double z_voxel_size)
+    : voxel_size_(voxel_size > 0.0 ? voxel_size : 1.0), z_voxel_size_(z_voxel_size)
+{
+}
+
+
+void SummaryStore::add(uint64_t target, double x, double y, double z, float rssi)
+{
+    if(std::isnan(rssi)){
+        return;
+    }
+
+    VoxelKey key;
+    key.target = target;
+    key.x = (int32_t)std::floor(x / voxel_size_);
+    key.y = (int32_t)std::floor(y / voxel_size_);
+    key.z = z_voxel_size_ > 0.0 ? (int32_t)std::floor(z / z_voxel_size_) : 0;
+
+    std::pair<VoxelStatistics, bool>& entry = voxels_[key];
+    entry.first.add(rssi);
+    if(!entry.second){
+        entry.second = true;
+        changed_.push_back(key);
+    }
+}
+
+
+bool SummaryStore::merge(const VoxelKey& key, const VoxelStatistics& stats)
+{
+    std::pair<VoxelStatistics, bool>& entry = voxels_[key];
+    if(!entry.first.merge(stats)){
+        return false;
+    }
+    if(!entry.second){
+        entry.second = true;
+        changed_.push_back(key);
+    }
+    return true;
+}
+
+
+void SummaryStore::take_changes(bool full, std::vector<VoxelEntry>& entries)
+{
+    entries.clear();
+
+    if(full){
+        for(Map::iterator it = voxels_.begin(); it != voxels_.end(); ++it){
+            it->second.second = false;
+            entries.push_back(VoxelEntry(it->first, it->second.first));
+        }
+    }
+    else{
+        for(std::size_t i = 0; i < changed_.size(); ++i){
+            std::pair<VoxelStatistics, bool>& entry = voxels_[changed_[i]];
+            entry.second = false;
+            entries.push_back(VoxelEntry(changed_[i], entry.first));
+        }
+    }
+    changed_.clear();
+}
+
+
+bool SummaryAggregator::merge(const std::string& robot, uint64_t incarnation,
+                              const VoxelKey& key, const VoxelStatistics& stats)
+{
+    return replicas_[Replica(robot, incarnation)].merge(key, stats);
+}
+
+
+std::size_t SummaryAggregator::robots() const
+{
+    // replicas are ordered by robot, the runs of one robot are adjacent
+    std::size_t count = 0;
+    const std::string* last = NULL;
+    for(std::map<Replica, SummaryStore>::const_iterator it = replicas_.begin(); it != replicas_.end(); ++it){
+        if(last == NULL || it->first.first != *last){
+            ++count;
+            last = &it->first.first;
+        }
+    }
+    return count;
+}
+
+
+void SummaryAggregator::totals(std::vector<VoxelEntry>& totals) const
+{
+    std::unordered_map<VoxelKey, VoxelStatistics, VoxelKeyHash> merged;
+
+    for(std::map<Replica, SummaryStore>::const_iterator replica = replicas_.begin(); replica != replicas_.end(); ++replica){
+        const SummaryStore::Map& voxels = replica->second.voxels();
+        for(SummaryStore::Map::const_iterator it = voxels.begin(); it != voxels.end(); ++it){
+            merged[it->first].accumulate(it->second.first);
+        }
+    }
+
+    totals.assign(merged.begin(), merged.end());
+}
+
+} // namespace detectssid
@@ -0,0 +1,201 @@
+/** Phone position particle filter
+ *
+ * Weights are kept as logarithms between updates so that long runs of
+ * unlikely observations do not underflow; they are exponentiated and
+ * normalized after every update.
+ *
+ */
+
+#include "detectssid/particle_filter.h"
+
+#include <cmath>
+
+namespace detectssid
+{
+
+ParticleFilter::ParticleFilter(const ParticleFilterParams& params, uint32_t seed)
+    : params_(params), rng_(seed), observations_(0), last_time_(-INFINITY)
+{
+    if(params_.particles < 16){
+        params_.particles = 16;
+    }
+}
+
+
+void ParticleFilter::seed(const RssiObservation& obs)
+{
+    const std::size_t n = params_.particles;
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::uniform_real_distribution<double> angle(0.0, 2.0 * M_PI);
+
+    x_.resize(n);
+    y_.resize(n);
+    z_.resize(n);
+    log_w_.assign(n, 0.0);
+    w_.assign(n, 1.0 / n);
+    rx_.resize(n);
+    ry_.resize(n);
+    rz_.resize(n);
+
+    for(std::size_t i = 0; i < n; ++i){
+        // sqrt makes the disc uniform in area
+        double r = params_.init_radius * std::sqrt(unit(rng_));
+        double a = angle(rng_);
+        x_[i] = obs.x + r * std::cos(a);
+        y_[i] = obs.y + r * std::sin(a);
+        z_[i] = obs.z + params_.init_height * (unit(rng_) - 0.5);
+    }
+}
+
+
+bool ParticleFilter::update(const RssiObservation& obs, const PathLossModel& model,
+                            const DistanceField* field)
+{
+    if(obs.t <= last_time_){
+        return false;
+    }
+    last_time_ = obs.t;
+
+    if(!initialized()){
+        seed(obs);
+    }
+
+    const long n = (long)x_.size();
+    const double inv_var = 1.0 / (model.sigma * model.sigma);
+    const double* x = x_.data();
+    const double* y = y_.data();
+    const double* z = z_.data();
+    double* log_w = log_w_.data();
+    double max_log_weight = -INFINITY;
+
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(max:max_log_weight) schedule(static)
+#endif
+    for(long i = 0; i < n; ++i){
+        double dx = x[i] - obs.x;
+        double dy = y[i] - obs.y;
+        double dz = z[i] - obs.z;
+        double planar = field != NULL ? field->distance(x[i], y[i]) : -1.0;
+        double distance = planar >= 0.0 ? std::sqrt(planar * planar + dz * dz)
+                                        : std::sqrt(dx * dx + dy * dy + dz * dz);
+        double residual = obs.rssi - model.expected_rssi(distance);
+        double lw = log_w[i] - 0.5 * residual * residual * inv_var;
+        log_w[i] = lw;
+        if(lw > max_log_weight){
+            max_log_weight = lw;
+        }
+    }
+
+    normalize(max_log_weight);
+    ++observations_;
+
+    if(effective_size() < 0.5 * n){
+        resample();
+    }
+    return true;
+}
+
+
+void ParticleFilter::normalize(double max_log_weight)
+{
+    const long n = (long)x_.size();
+    double* log_w = log_w_.data();
+    double* w = w_.data();
+    double sum = 0.0;
+
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(+:sum) schedule(static)
+#endif
+    for(long i = 0; i < n; ++i){
+        double lw = log_w[i] - max_log_weight;
+        log_w[i] = lw;
+        w[i] = std::exp(lw);
+        sum += w[i];
+    }
+
+    const double inv_sum = 1.0 / sum;
+    const double log_sum = std::log(sum);
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for(long i = 0; i < n; ++i){
+        w[i] *= inv_sum;
+        log_w[i] -= log_sum;
+    }
+}
+
+
+double ParticleFilter::effective_size() const
+{
+    double sum_sq = 0.0;
+    for(std::size_t i = 0; i < w_.size(); ++i){
+        sum_sq += w_[i] * w_[i];
+    }
+    return sum_sq > 0.0 ? 1.0 / sum_sq : 0.0;
+}
+
+
+void ParticleFilter::resample()
+{
+    // systematic resampling, one random offset for all draws
+    const std::size_t n = x_.size();
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    // a standard deviation of 0 is out of the distribution's domain, it turns roughening off
+    const bool roughen = params_.roughening > 0.0;
+    std::normal_distribution<double> jitter(0.0, roughen ? params_.roughening : 1.0);
+
+    double step = 1.0 / n;
+    double u = unit(rng_) * step;
+    double cumulative = w_[0];
+    std::size_t j = 0;
+
+    for(std::size_t i = 0; i < n; ++i){
+        while(u > cumulative && j + 1 < n){
+            cumulative += w_[++j];
+        }
+        rx_[i] = x_[j];
+        ry_[i] = y_[j];
+        rz_[i] = z_[j];
+        if(roughen){
+            rx_[i] += jitter(rng_);
+            ry_[i] += jitter(rng_);
+            rz_[i] += jitter(rng_);
+        }
+        u += step;
+    }
+
+    x_.swap(rx_);
+    y_.swap(ry_);
+    z_.swap(rz_);
+    w_.assign(n, step);
+    log_w_.assign(n, -std::log((double)n));
+}
+
+
+void ParticleFilter::estimate(PositionEstimate& out) const
+{
+    out.x = out.y = out.z = 0.0;
+    for(int k = 0; k < 9; ++k){
+        out.cov[k] = 0.0;
+    }
+    out.observations = observations_;
+
+    const std::size_t n = x_.size();
+    for(std::size_t i = 0; i < n; ++i){
+        out.x += w_[i] * x_[i];
+        out.y += w_[i] * y_[i];
+        out.z += w_[i] * z_[i];
+    }
+
+    for(std::size_t i = 0; i < n; ++i){
+        double d[3] = { x_[i] - out.x, y_[i] - out.y, z_[i] - out.z };
+        for(int r = 0; r < 3; ++r){
+            for(int c = 0; c < 3; ++c){
+                out.cov[r * 3 + c] += w_[i] * d[r] * d[c];
+            }
+        }
+    }
+}
+
+} // namespace detectssid
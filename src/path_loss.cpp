@@ -0,0 +1,176 @@
+/** Log-distance path loss calibration
+ *
+ * Recursive least squares with forgetting factor lambda, regressor
+ * phi = (1, -10 log10 d) and measurement y = rssi:
+ *
+ *   k     = P phi / (lambda + phi' P phi)
+ *   theta = theta + k (y - phi' theta)
+ *   P     = (P - k phi' P) / lambda
+ *
+ * The state is saved as plain "key: value" lines so that it can be read
+ * and edited by hand, and loaded as ROS parameters if needed.
+ *
+ */
+
+#include "detectssid/path_loss.h"
+
+#include <cerrno>
+#include <cstdio>           // fopen, fprintf
+#include <cstring>          // strerror
+
+namespace detectssid
+{
+
+namespace
+{
+
+/// prior variance of ref_power (dB^2) and exponent, weak enough for data to dominate quickly
+const double kPriorVarPower = 100.0;
+const double kPriorVarExponent = 1.0;
+
+/// smallest spread of log10 distance that makes the exponent observable, a factor of 2
+const double kMinLogSpread = 0.3;
+
+} // namespace
+
+
+PathLossCalibrator::PathLossCalibrator(double forgetting)
+    : lambda_(forgetting > 0.0 && forgetting <= 1.0 ? forgetting : 1.0)
+{
+    reset(PathLossModel());
+}
+
+
+void PathLossCalibrator::reset(const PathLossModel& prior)
+{
+    theta_[0] = prior.ref_power;
+    theta_[1] = prior.exponent;
+    p_[0] = kPriorVarPower;
+    p_[1] = 0.0;
+    p_[2] = kPriorVarExponent;
+    residual_var_ = prior.sigma * prior.sigma;
+    min_log_d_ = INFINITY;
+    max_log_d_ = -INFINITY;
+    samples_ = 0;
+}
+
+
+void PathLossCalibrator::add(double distance, double rssi)
+{
+    if(!(distance > 0.0) || std::isnan(rssi)){
+        return;
+    }
+
+    double log_d = std::log10(distance < 0.5 ? 0.5 : distance);
+    double phi0 = 1.0;
+    double phi1 = -10.0 * log_d;
+
+    // P phi
+    double pphi0 = p_[0] * phi0 + p_[1] * phi1;
+    double pphi1 = p_[1] * phi0 + p_[2] * phi1;
+    double denom = lambda_ + phi0 * pphi0 + phi1 * pphi1;
+    double k0 = pphi0 / denom;
+    double k1 = pphi1 / denom;
+
+    double residual = rssi - (theta_[0] * phi0 + theta_[1] * phi1);
+    theta_[0] += k0 * residual;
+    theta_[1] += k1 * residual;
+
+    // P = (P - k (P phi)') / lambda, P is symmetric so phi' P = (P phi)'
+    double inv_lambda = 1.0 / lambda_;
+    p_[0] = (p_[0] - k0 * pphi0) * inv_lambda;
+    p_[1] = (p_[1] - k0 * pphi1) * inv_lambda;
+    p_[2] = (p_[2] - k1 * pphi1) * inv_lambda;
+
+    // a running mean until the forgetting factor weighs the new residual more, with lambda 1
+    // for good; a priori residuals overestimate the noise early on, forgetting washes that out
+    double weight = 1.0 / (double)(samples_ + 1);
+    if(weight < 1.0 - lambda_){
+        weight = 1.0 - lambda_;
+    }
+    residual_var_ += weight * (residual * residual - residual_var_);
+
+    if(log_d < min_log_d_) min_log_d_ = log_d;
+    if(log_d > max_log_d_) max_log_d_ = log_d;
+    ++samples_;
+}
+
+
+bool PathLossCalibrator::apply(PathLossModel& model, std::size_t min_samples) const
+{
+    if(samples_ < min_samples || max_log_d_ - min_log_d_ < kMinLogSpread){
+        return false;
+    }
+
+    model.ref_power = theta_[0];
+    model.exponent = theta_[1];
+    model.sigma = std::sqrt(residual_var_);
+    return true;
+}
+
+
+int PathLossCalibrator::save(const char* filename) const
+{
+    char tmpname[4096];
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+
+    FILE* fp = fopen(tmpname, "w");
+    if(fp == NULL){
+        fprintf(stderr, "could not write %s, errno: %s\n", tmpname, strerror(errno));
+        return -1;
+    }
+
+    fprintf(fp, "ref_power: %.17g\n", theta_[0]);
+    fprintf(fp, "exponent: %.17g\n", theta_[1]);
+    fprintf(fp, "p00: %.17g\n", p_[0]);
+    fprintf(fp, "p01: %.17g\n", p_[1]);
+    fprintf(fp, "p11: %.17g\n", p_[2]);
+    fprintf(fp, "residual_var: %.17g\n", residual_var_);
+    fprintf(fp, "min_log_d: %.17g\n", min_log_d_);
+    fprintf(fp, "max_log_d: %.17g\n", max_log_d_);
+    fprintf(fp, "samples: %zu\n", samples_);
+
+    if(fclose(fp) != 0 || rename(tmpname, filename) != 0){
+        fprintf(stderr, "could not write %s, errno: %s\n", filename, strerror(errno));
+        remove(tmpname);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int PathLossCalibrator::load(const char* filename)
+{
+    FILE* fp = fopen(filename, "r");
+    if(fp == NULL){
+        return -1;
+    }
+
+    double theta[2], p[3], residual_var, min_log_d, max_log_d;
+    std::size_t samples;
+    int fields = fscanf(fp,
+                        " ref_power: %lf exponent: %lf p00: %lf p01: %lf p11: %lf"
+                        " residual_var: %lf min_log_d: %lf max_log_d: %lf samples: %zu",
+                        &theta[0], &theta[1], &p[0], &p[1], &p[2],
+                        &residual_var, &min_log_d, &max_log_d, &samples);
+    fclose(fp);
+
+    if(fields != 9 || !(p[0] > 0.0) || !(p[2] > 0.0) || !(residual_var >= 0.0)){
+        fprintf(stderr, "%s is not a valid path loss calibration file\n", filename);
+        return -1;
+    }
+
+    theta_[0] = theta[0];
+    theta_[1] = theta[1];
+    p_[0] = p[0];
+    p_[1] = p[1];
+    p_[2] = p[2];
+    residual_var_ = residual_var;
+    min_log_d_ = min_log_d;
+    max_log_d_ = max_log_d;
+    samples_ = samples;
+    return 0;
+}
+
+} // namespace detectssid
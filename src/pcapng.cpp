@@ -0,0 +1,352 @@
+/** pcapng capture files of monitor mode frames
+ */
+
+#include "detectssid/pcapng.h"
+#include "detectssid/byte_order.h"
+
+#include <cerrno>
+#include <cmath>            // ldexp
+#include <cstdio>           // fprintf, snprintf
+#include <cstdlib>          // strtol
+#include <cstring>          // strerror, strncmp
+#include <dirent.h>         // opendir, readdir
+#include <fcntl.h>          // open
+#include <vector>
+#include <sys/mman.h>       // mmap
+#include <sys/stat.h>       // fstat
+#include <sys/uio.h>        // writev
+#include <unistd.h>         // write, close, unlink
+
+namespace detectssid
+{
+
+namespace
+{
+
+const uint32_t kSectionHeaderBlock = 0x0a0d0d0a;
+const uint32_t kInterfaceBlock = 1;
+const uint32_t kEnhancedPacketBlock = 6;
+const uint32_t kByteOrderMagic = 0x1a2b3c4d;
+const uint16_t kOptionEnd = 0;
+const uint16_t kOptionTsresol = 9;
+const std::size_t kFileHeaderSize = 28 + 32;    // section header and interface blocks
+const std::size_t kPacketHeaderSize = 28;
+
+} // namespace
+
+
+PcapngWriter::PcapngWriter()
+    : max_file_bytes_(0), max_files_(0), index_(0), fd_(-1), size_(0)
+{
+}
+
+
+PcapngWriter::~PcapngWriter()
+{
+    close();
+}
+
+
+std::string PcapngWriter::file_name(long index) const
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "-%ld.pcapng", index);
+    return prefix_ + suffix;
+}
+
+
+/// numbers the capture after the files of an earlier run, removes those beyond max_files
+long PcapngWriter::resume()
+{
+    std::string dir = ".";
+    std::string base = prefix_;
+    std::string::size_type slash = prefix_.rfind('/');
+    if(slash != std::string::npos){
+        dir = slash == 0 ? "/" : prefix_.substr(0, slash);
+        base = prefix_.substr(slash + 1);
+    }
+
+    DIR* d = opendir(dir.c_str());
+    if(d == NULL){
+        return 0;
+    }
+    std::vector<long> found;
+    struct dirent* entry;
+    while((entry = readdir(d)) != NULL){
+        const char* name = entry->d_name;
+        if(strncmp(name, base.c_str(), base.size()) != 0 || name[base.size()] != '-'){
+            continue;
+        }
+        const char* digits = name + base.size() + 1;
+        char* end;
+        long index = strtol(digits, &end, 10);
+        if(end != digits && *digits != '-' && strcmp(end, ".pcapng") == 0){
+            found.push_back(index);
+        }
+    }
+    closedir(d);
+
+    long next = 0;
+    for(std::size_t i = 0; i < found.size(); ++i){
+        if(found[i] >= next){
+            next = found[i] + 1;
+        }
+    }
+    for(std::size_t i = 0; i < found.size(); ++i){
+        if(found[i] <= next - max_files_){
+            unlink(file_name(found[i]).c_str());
+        }
+    }
+    return next;
+}
+
+
+int PcapngWriter::open(const char* prefix, std::size_t max_file_bytes, int max_files)
+{
+    close();
+    prefix_ = prefix;
+    max_file_bytes_ = max_file_bytes < 65536 ? 65536 : max_file_bytes;
+    max_files_ = max_files < 1 ? 1 : max_files;
+    index_ = resume();
+    return start_file();
+}
+
+
+void PcapngWriter::close()
+{
+    if(fd_ >= 0){
+        ::close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+}
+
+
+int PcapngWriter::start_file()
+{
+    close();
+
+    std::string name = file_name(index_);
+    fd_ = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd_ < 0){
+        fprintf(stderr, "could not write %s, errno: %s\n", name.c_str(), strerror(errno));
+        return -1;
+    }
+    if(index_ >= max_files_){
+        unlink(file_name(index_ - max_files_).c_str());
+    }
+
+    // section header, no options
+    uint8_t header[kFileHeaderSize];
+    uint8_t* p = header;
+    put_le(p, kSectionHeaderBlock, 4);
+    put_le(p + 4, 28, 4);
+    put_le(p + 8, kByteOrderMagic, 4);
+    put_le(p + 12, 1, 2);               // version 1.0
+    put_le(p + 14, 0, 2);
+    put_le(p + 16, ~0ull, 8);           // section length not known
+    put_le(p + 24, 28, 4);
+
+    // the one interface, radiotap, timestamps in ns
+    p = header + 28;
+    put_le(p, kInterfaceBlock, 4);
+    put_le(p + 4, 32, 4);
+    put_le(p + 8, kLinkTypeRadiotap, 2);
+    put_le(p + 10, 0, 2);
+    put_le(p + 12, 0, 4);               // no snap length
+    put_le(p + 16, kOptionTsresol, 2);
+    put_le(p + 18, 1, 2);
+    put_le(p + 20, 9, 4);               // 10^-9 s, padded
+    put_le(p + 24, kOptionEnd, 4);
+    put_le(p + 28, 32, 4);
+
+    if(::write(fd_, header, sizeof(header)) != (ssize_t)sizeof(header)){
+        fprintf(stderr, "could not write %s, errno: %s\n", name.c_str(), strerror(errno));
+        close();
+        return -1;
+    }
+    size_ = sizeof(header);
+    return 0;
+}
+
+
+int PcapngWriter::write(uint64_t time_ns, const uint8_t* data, uint32_t len, uint32_t orig_len)
+{
+    if(fd_ < 0){
+        return -1;
+    }
+
+    uint32_t padded = (len + 3) & ~3u;
+    uint32_t total = kPacketHeaderSize + padded + 4;
+    if(size_ + total > max_file_bytes_ && size_ > kFileHeaderSize){
+        ++index_;
+        if(start_file() != 0){
+            return -1;
+        }
+    }
+
+    uint8_t head[kPacketHeaderSize];
+    put_le(head, kEnhancedPacketBlock, 4);
+    put_le(head + 4, total, 4);
+    put_le(head + 8, 0, 4);             // interface
+    put_le(head + 12, time_ns >> 32, 4);
+    put_le(head + 16, time_ns & 0xffffffffu, 4);
+    put_le(head + 20, len, 4);
+    put_le(head + 24, orig_len, 4);
+
+    uint8_t tail[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    uint32_t pad = padded - len;
+    put_le(tail + pad, total, 4);
+
+    // the frame is written from where it lies
+    struct iovec iov[3];
+    iov[0].iov_base = head;
+    iov[0].iov_len = sizeof(head);
+    iov[1].iov_base = (void*)data;
+    iov[1].iov_len = len;
+    iov[2].iov_base = tail;
+    iov[2].iov_len = pad + 4;
+    if(writev(fd_, iov, 3) != (ssize_t)total){
+        fprintf(stderr, "could not write capture, errno: %s\n", strerror(errno));
+        return -1;
+    }
+    size_ += total;
+    return 0;
+}
+
+
+PcapngReader::PcapngReader()
+    : base_(NULL), size_(0), offset_(0)
+{
+}
+
+
+PcapngReader::~PcapngReader()
+{
+    close();
+}
+
+
+int PcapngReader::open(const char* filename)
+{
+    close();
+
+    int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        fprintf(stderr, "could not open %s, errno: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < 28){
+        fprintf(stderr, "%s is not a pcapng file\n", filename);
+        ::close(fd);
+        return -1;
+    }
+    void* p = mmap(NULL, (std::size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(p == MAP_FAILED){
+        fprintf(stderr, "could not map %s, errno: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    base_ = (const uint8_t*)p;
+    size_ = (std::size_t)st.st_size;
+
+    if(get_le(base_, 4) != kSectionHeaderBlock){
+        fprintf(stderr, "%s is not a pcapng file\n", filename);
+        close();
+        return -1;
+    }
+    madvise((void*)base_, size_, MADV_SEQUENTIAL);
+    return 0;
+}
+
+
+void PcapngReader::close()
+{
+    if(base_ != NULL){
+        munmap((void*)base_, size_);
+        base_ = NULL;
+    }
+    size_ = 0;
+    offset_ = 0;
+    interfaces_.clear();
+}
+
+
+void PcapngReader::add_interface(const uint8_t* body, std::size_t len)
+{
+    Interface interface;
+    interface.link_type = len >= 2 ? (uint16_t)get_le(body, 2) : 0;
+    interface.binary = false;
+    interface.exponent = 6;             // microseconds unless stated
+
+    std::size_t offset = 8;
+    while(offset + 4 <= len){
+        uint16_t code = (uint16_t)get_le(body + offset, 2);
+        uint16_t option_len = (uint16_t)get_le(body + offset + 2, 2);
+        if(code == kOptionEnd || offset + 4 + option_len > len){
+            break;
+        }
+        if(code == kOptionTsresol && option_len >= 1){
+            uint8_t value = body[offset + 4];
+            interface.binary = (value & 0x80) != 0;
+            interface.exponent = value & 0x7f;
+        }
+        offset += 4 + ((option_len + 3) & ~3u);
+    }
+    interfaces_.push_back(interface);
+}
+
+
+bool PcapngReader::next(PcapngPacket& packet)
+{
+    while(base_ != NULL && offset_ + 12 <= size_){
+        const uint8_t* p = base_ + offset_;
+        uint32_t type = (uint32_t)get_le(p, 4);
+        std::size_t len = (std::size_t)get_le(p + 4, 4);
+        if(len < 12 || len % 4 != 0 || offset_ + len > size_){
+            return false;
+        }
+        offset_ += len;
+
+        if(type == kSectionHeaderBlock){
+            if(len < 28 || get_le(p + 8, 4) != kByteOrderMagic){
+                fprintf(stderr, "big endian pcapng sections are not supported\n");
+                return false;
+            }
+            interfaces_.clear();
+        }
+        else if(type == kInterfaceBlock){
+            add_interface(p + 8, len - 12);
+        }
+        else if(type == kEnhancedPacketBlock && len >= kPacketHeaderSize + 4){
+            uint32_t id = (uint32_t)get_le(p + 8, 4);
+            uint64_t ts = get_le(p + 12, 4) << 32 | get_le(p + 16, 4);
+            uint32_t caplen = (uint32_t)get_le(p + 20, 4);
+            if(id >= interfaces_.size() || kPacketHeaderSize + caplen + 4 > len){
+                continue;
+            }
+
+            const Interface& interface = interfaces_[id];
+            if(interface.binary){
+                packet.time_ns = (uint64_t)std::ldexp((long double)ts * 1e9L, -interface.exponent);
+            }
+            else{
+                packet.time_ns = ts;
+                for(int e = interface.exponent; e < 9; ++e){
+                    packet.time_ns *= 10;
+                }
+                for(int e = interface.exponent; e > 9; --e){
+                    packet.time_ns /= 10;
+                }
+            }
+            packet.link_type = interface.link_type;
+            packet.data = p + kPacketHeaderSize;
+            packet.len = caplen;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace detectssid
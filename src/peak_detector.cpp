@@ -0,0 +1,60 @@
+/** Closest approach detector
+ */
+
+#include "detectssid/peak_detector.h"
+
+#include <cmath>            // sqrt, isnan, INFINITY
+
+namespace detectssid
+{
+
+PeakDetector::PeakDetector(const PeakDetectorParams& params)
+    : params_(params), seeking_peak_(true), extreme_(-INFINITY),
+      extreme_pose_(), last_time_(-INFINITY)
+{
+}
+
+
+bool PeakDetector::add(const PoseSample& pose, float rssi, float variance, PeakEvent& event)
+{
+    // repeated reports of the same beacon, and unconverged filter output, carry no information
+    if(pose.t <= last_time_ || std::isnan(rssi) || std::sqrt(variance) > params_.max_stddev_db){
+        return false;
+    }
+    last_time_ = pose.t;
+
+    if(!seeking_peak_){
+        if(rssi < extreme_){
+            extreme_ = rssi;
+        }
+        else if(rssi > extreme_ + params_.drop_db){
+            // rose out of the valley, start looking for the next peak
+            seeking_peak_ = true;
+            extreme_ = rssi;
+            extreme_pose_ = pose;
+        }
+        return false;
+    }
+
+    if(rssi >= extreme_){
+        extreme_ = rssi;
+        extreme_pose_ = pose;
+        return false;
+    }
+
+    if(rssi < extreme_ - params_.drop_db){
+        bool report = extreme_ >= params_.threshold_dbm;
+        if(report){
+            event.pose = extreme_pose_;
+            event.rssi = extreme_;
+            event.prominence = extreme_ - rssi;
+        }
+        seeking_peak_ = false;
+        extreme_ = rssi;
+        return report;
+    }
+
+    return false;
+}
+
+} // namespace detectssid
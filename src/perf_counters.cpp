@@ -0,0 +1,141 @@
+/** CPU cost of the detection pipeline stages
+ */
+
+#include "detectssid/perf_counters.h"
+
+#include <cerrno>
+#include <cstdio>           // fprintf
+#include <cstring>          // memset, strerror
+#include <linux/perf_event.h>
+#include <sys/syscall.h>    // SYS_perf_event_open
+#include <unistd.h>         // syscall, read, close
+
+namespace detectssid
+{
+
+namespace
+{
+
+int perf_event_open(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.inherit = 1;           // the scan command runs in child processes
+    attr.exclude_kernel = type == PERF_TYPE_HARDWARE;  // allowed without privileges
+    attr.exclude_hv = 1;
+
+    // this thread, any cpu
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+} // namespace
+
+
+PerfCounters::PerfCounters(int stages)
+    : stages_(stages), totals_(new std::atomic<uint64_t>[stages * kPerfCounters]),
+      samples_(new std::atomic<uint64_t>[stages])
+{
+    for(int i = 0; i < kPerfCounters; ++i){
+        fd_[i] = -1;
+        last_[i] = 0;
+    }
+    for(int i = 0; i < stages_ * kPerfCounters; ++i){
+        totals_[i].store(0, std::memory_order_relaxed);
+    }
+    for(int i = 0; i < stages_; ++i){
+        samples_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+
+PerfCounters::~PerfCounters()
+{
+    for(int i = 0; i < kPerfCounters; ++i){
+        if(fd_[i] >= 0){
+            close(fd_[i]);
+        }
+    }
+}
+
+
+const char* PerfCounters::name(int counter)
+{
+    static const char* const names[kPerfCounters] = {
+        "task clock", "instructions", "context switches", "page faults"
+    };
+    return names[counter];
+}
+
+
+int PerfCounters::open()
+{
+    static const uint32_t types[kPerfCounters] = {
+        PERF_TYPE_SOFTWARE, PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE
+    };
+    static const uint64_t configs[kPerfCounters] = {
+        PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_PAGE_FAULTS
+    };
+
+    int opened = 0;
+    for(int i = 0; i < kPerfCounters; ++i){
+        if(fd_[i] < 0){
+            fd_[i] = perf_event_open(types[i], configs[i]);
+        }
+        if(fd_[i] < 0){
+            fprintf(stderr, "no %s counter, errno: %s\n", name(i), strerror(errno));
+        }
+        else{
+            ++opened;
+        }
+    }
+    return opened > 0 ? 0 : -1;
+}
+
+
+void PerfCounters::read(uint64_t values[kPerfCounters]) const
+{
+    for(int i = 0; i < kPerfCounters; ++i){
+        values[i] = 0;
+        if(fd_[i] >= 0 && ::read(fd_[i], &values[i], sizeof(values[i])) != (ssize_t)sizeof(values[i])){
+            values[i] = 0;
+        }
+    }
+}
+
+
+void PerfCounters::start()
+{
+    read(last_);
+}
+
+
+void PerfCounters::mark(int stage)
+{
+    uint64_t now[kPerfCounters];
+    read(now);
+    for(int i = 0; i < kPerfCounters; ++i){
+        if(now[i] >= last_[i]){
+            totals_[stage * kPerfCounters + i].fetch_add(now[i] - last_[i], std::memory_order_relaxed);
+        }
+        last_[i] = now[i];
+    }
+    samples_[stage].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+uint64_t PerfCounters::total(int stage, int counter) const
+{
+    return totals_[stage * kPerfCounters + counter].load(std::memory_order_relaxed);
+}
+
+
+uint64_t PerfCounters::samples(int stage) const
+{
+    return samples_[stage].load(std::memory_order_relaxed);
+}
+
+} // namespace detectssid
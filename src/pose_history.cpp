@@ -0,0 +1,142 @@
+/** Robot pose history
+ */
+
+#include "detectssid/pose_history.h"
+
+#include <cmath>            // acos, sin
+
+namespace detectssid
+{
+
+namespace
+{
+
+/// spherical linear interpolation between unit quaternions a and b
+void slerp(const PoseSample& a, const PoseSample& b, double s, PoseSample& out)
+{
+    double dot = a.qx * b.qx + a.qy * b.qy + a.qz * b.qz + a.qw * b.qw;
+    double sign = 1.0;
+
+    // take the short way around
+    if(dot < 0.0){
+        dot = -dot;
+        sign = -1.0;
+    }
+
+    double wa, wb;
+    if(dot > 0.9995){
+        // nearly parallel, linear interpolation is exact enough and stable
+        wa = 1.0 - s;
+        wb = s;
+    }
+    else{
+        double theta = std::acos(dot);
+        double inv_sin = 1.0 / std::sin(theta);
+        wa = std::sin((1.0 - s) * theta) * inv_sin;
+        wb = std::sin(s * theta) * inv_sin;
+    }
+    wb *= sign;
+
+    out.qx = wa * a.qx + wb * b.qx;
+    out.qy = wa * a.qy + wb * b.qy;
+    out.qz = wa * a.qz + wb * b.qz;
+    out.qw = wa * a.qw + wb * b.qw;
+
+    double norm = std::sqrt(out.qx * out.qx + out.qy * out.qy + out.qz * out.qz + out.qw * out.qw);
+    if(norm > 0.0){
+        out.qx /= norm;
+        out.qy /= norm;
+        out.qz /= norm;
+        out.qw /= norm;
+    }
+}
+
+} // namespace
+
+
+PoseHistory::PoseHistory(std::size_t capacity, double max_gap)
+    : ring_(capacity < 2 ? 2 : capacity), head_(0), count_(0), max_gap_(max_gap)
+{
+}
+
+
+void PoseHistory::push(const PoseSample& pose)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if(count_ > 0 && pose.t <= at(count_ - 1).t){
+        return;
+    }
+
+    if(count_ < ring_.size()){
+        ring_[(head_ + count_) % ring_.size()] = pose;
+        ++count_;
+    }
+    else{
+        // overwrite the oldest pose
+        ring_[head_] = pose;
+        head_ = (head_ + 1) % ring_.size();
+    }
+}
+
+
+bool PoseHistory::lookup(double t, PoseSample& pose) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if(count_ == 0 || t < at(0).t){
+        return false;
+    }
+
+    const PoseSample& last = at(count_ - 1);
+    if(t >= last.t){
+        if(t - last.t > max_gap_){
+            return false;
+        }
+        pose = last;
+        pose.t = t;
+        return true;
+    }
+
+    // binary search for the first pose newer than t
+    std::size_t lo = 0, hi = count_ - 1;
+    while(lo < hi){
+        std::size_t mid = (lo + hi) / 2;
+        if(at(mid).t <= t){
+            lo = mid + 1;
+        }
+        else{
+            hi = mid;
+        }
+    }
+
+    const PoseSample& a = at(lo - 1);
+    const PoseSample& b = at(lo);
+    if(b.t - a.t > max_gap_){
+        return false;
+    }
+
+    double s = (t - a.t) / (b.t - a.t);
+    pose.t = t;
+    pose.x = a.x + s * (b.x - a.x);
+    pose.y = a.y + s * (b.y - a.y);
+    pose.z = a.z + s * (b.z - a.z);
+    slerp(a, b, s, pose);
+    return true;
+}
+
+
+double PoseHistory::newest() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_ > 0 ? at(count_ - 1).t : 0.0;
+}
+
+
+std::size_t PoseHistory::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_;
+}
+
+} // namespace detectssid
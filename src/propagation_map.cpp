@@ -0,0 +1,222 @@
+/** Map aware signal propagation distance
+ */
+
+#include "detectssid/propagation_map.h"
+
+#include <cmath>            // ceil, floor, sqrt
+#include <functional>       // greater
+#include <queue>            // priority_queue
+#include <utility>          // pair
+
+namespace detectssid
+{
+
+PropagationMap::PropagationMap(const PropagationParams& params)
+    : params_(params), width_(0), height_(0), map_resolution_(0.0),
+      origin_x_(0.0), origin_y_(0.0), coarse_width_(0), coarse_height_(0), ratio_(1)
+{
+    if(params_.cache_size < 1){
+        params_.cache_size = 1;
+    }
+}
+
+
+void PropagationMap::set_map(const int8_t* data, uint32_t width, uint32_t height,
+                             double resolution, double origin_x, double origin_y)
+{
+    if(width == width_ && height == height_ && resolution == map_resolution_
+       && origin_x == origin_x_ && origin_y == origin_y_){
+        update_region(data, 0, 0, width, height);
+        return;
+    }
+
+    // the map grew or moved, rebuild everything
+    width_ = width;
+    height_ = height;
+    map_resolution_ = resolution;
+    origin_x_ = origin_x;
+    origin_y_ = origin_y;
+    cells_.assign(data, data + (std::size_t)width * height);
+    cache_.clear();
+
+    ratio_ = (int32_t)std::ceil(params_.resolution / resolution - 1e-6);
+    if(ratio_ < 1){
+        ratio_ = 1;
+    }
+    coarse_width_ = ((int32_t)width + ratio_ - 1) / ratio_;
+    coarse_height_ = ((int32_t)height + ratio_ - 1) / ratio_;
+    walls_.assign((std::size_t)coarse_width_ * coarse_height_, 0);
+
+    for(uint32_t y = 0; y < height; ++y){
+        for(uint32_t x = 0; x < width; ++x){
+            if(cells_[(std::size_t)y * width + x] >= params_.occupied_threshold){
+                ++walls_[(std::size_t)(y / ratio_) * coarse_width_ + x / ratio_];
+            }
+        }
+    }
+}
+
+
+void PropagationMap::update_region(const int8_t* data, int32_t x, int32_t y, uint32_t width, uint32_t height)
+{
+    if(cells_.empty()){
+        return;
+    }
+
+    const int threshold = params_.occupied_threshold;
+    int32_t cx0 = INT32_MAX, cy0 = INT32_MAX, cx1 = -1, cy1 = -1;
+
+    for(uint32_t row = 0; row < height; ++row){
+        int32_t my = y + (int32_t)row;
+        if(my < 0 || my >= (int32_t)height_){
+            continue;
+        }
+        for(uint32_t col = 0; col < width; ++col){
+            int32_t mx = x + (int32_t)col;
+            if(mx < 0 || mx >= (int32_t)width_){
+                continue;
+            }
+
+            int8_t& cell = cells_[(std::size_t)my * width_ + mx];
+            int8_t value = data[(std::size_t)row * width + col];
+            bool was_wall = cell >= threshold;
+            bool is_wall = value >= threshold;
+            cell = value;
+            if(was_wall == is_wall){
+                continue;
+            }
+
+            int32_t cx = mx / ratio_;
+            int32_t cy = my / ratio_;
+            uint16_t& walls = walls_[(std::size_t)cy * coarse_width_ + cx];
+            uint16_t before = walls;
+            walls = is_wall ? walls + 1 : walls - 1;
+
+            // only a coarse cell turning free <-> wall changes any field
+            if((before == 0) != (walls == 0)){
+                if(cx < cx0) cx0 = cx;
+                if(cy < cy0) cy0 = cy;
+                if(cx > cx1) cx1 = cx;
+                if(cy > cy1) cy1 = cy;
+            }
+        }
+    }
+
+    if(cx1 >= 0){
+        invalidate(cx0, cy0, cx1, cy1);
+    }
+}
+
+
+void PropagationMap::invalidate(int32_t cx0, int32_t cy0, int32_t cx1, int32_t cy1)
+{
+    for(std::list<DistanceField>::iterator it = cache_.begin(); it != cache_.end(); ){
+        bool overlaps = cx0 < it->window_x_ + it->size_ && cx1 >= it->window_x_
+                     && cy0 < it->window_y_ + it->size_ && cy1 >= it->window_y_;
+        if(overlaps){
+            it = cache_.erase(it);
+        }
+        else{
+            ++it;
+        }
+    }
+}
+
+
+const DistanceField* PropagationMap::field(double x, double y)
+{
+    if(cells_.empty()){
+        return NULL;
+    }
+
+    double coarse = map_resolution_ * ratio_;
+    int32_t cx = (int32_t)std::floor((x - origin_x_) / coarse);
+    int32_t cy = (int32_t)std::floor((y - origin_y_) / coarse);
+    if(cx < 0 || cy < 0 || cx >= coarse_width_ || cy >= coarse_height_){
+        return NULL;
+    }
+
+    for(std::list<DistanceField>::iterator it = cache_.begin(); it != cache_.end(); ++it){
+        if(it->source_cx_ == cx && it->source_cy_ == cy){
+            cache_.splice(cache_.begin(), cache_, it);
+            return &cache_.front();
+        }
+    }
+
+    if(cache_.size() >= params_.cache_size){
+        cache_.pop_back();
+    }
+
+    cache_.push_front(DistanceField());
+    DistanceField& f = cache_.front();
+    int32_t radius = (int32_t)std::ceil(params_.max_range / coarse);
+    f.source_cx_ = cx;
+    f.source_cy_ = cy;
+    f.window_x_ = cx - radius;
+    f.window_y_ = cy - radius;
+    f.size_ = 2 * radius + 1;
+    f.origin_x_ = origin_x_ + f.window_x_ * coarse;
+    f.origin_y_ = origin_y_ + f.window_y_ * coarse;
+    f.inv_resolution_ = 1.0 / coarse;
+    compute(f);
+    return &f;
+}
+
+
+void PropagationMap::compute(DistanceField& f) const
+{
+    typedef std::pair<float, int32_t> Entry;
+
+    const double coarse = map_resolution_ * ratio_;
+    const int32_t size = f.size_;
+    const float max_range = (float)params_.max_range;
+    const float step[8] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.41421356f, 1.41421356f, 1.41421356f, 1.41421356f };
+    const int32_t dx[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+    const int32_t dy[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+    // cells not reached within max_range keep max_range, the weakest level the model expects
+    f.dist_.assign((std::size_t)size * size, max_range);
+
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > open;
+    int32_t start = (f.source_cy_ - f.window_y_) * size + (f.source_cx_ - f.window_x_);
+    f.dist_[start] = 0.0f;
+    open.push(Entry(0.0f, start));
+
+    while(!open.empty()){
+        Entry e = open.top();
+        open.pop();
+        if(e.first > f.dist_[e.second]){
+            continue;
+        }
+
+        int32_t wx = e.second % size;
+        int32_t wy = e.second / size;
+
+        for(int k = 0; k < 8; ++k){
+            int32_t nx = wx + dx[k];
+            int32_t ny = wy + dy[k];
+            if(nx < 0 || ny < 0 || nx >= size || ny >= size){
+                continue;
+            }
+
+            // cells beyond the map edge are unexplored, treat them as open
+            int32_t mx = f.window_x_ + nx;
+            int32_t my = f.window_y_ + ny;
+            bool wall = mx >= 0 && my >= 0 && mx < coarse_width_ && my < coarse_height_
+                     && walls_[(std::size_t)my * coarse_width_ + mx] > 0;
+
+            float cost = e.first + (float)(step[k] * coarse + (wall ? params_.wall_penalty : 0.0));
+            if(cost > max_range){
+                continue;
+            }
+
+            float& d = f.dist_[(std::size_t)ny * size + nx];
+            if(cost < d){
+                d = cost;
+                open.push(Entry(cost, ny * size + nx));
+            }
+        }
+    }
+}
+
+} // namespace detectssid
@@ -0,0 +1,99 @@
+/** Base station side of the udp detection bridge
+ *
+ *  Purpose: receives the compact detection batches sent by detectssid
+ *  nodes with ~udp_bridge_host set, and republishes every record as a
+ *  Detection on wifiDetection.
+ *
+ *  Records carry no network name, only the index of the matched target;
+ *  ~target_names maps it back. Orientation, rssi_ema and rssi_variance
+ *  are not sent and are published as identity and NaN.
+ *
+ */
+
+#include <cmath>            // NAN
+#include <cstdio>           // fprintf
+#include <map>
+#include <string>
+#include <vector>
+#include "ros/ros.h"
+
+#include "detectssid/Detection.h"
+#include "detectssid/bss.h"
+#include "detectssid/detection_record.h"
+#include "detectssid/udp_link.h"
+
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "report_decoder");
+    ros::NodeHandle n;
+    ros::NodeHandle pn("~");
+
+    int port;
+    std::string frame;
+    std::vector<std::string> target_names;
+    pn.param("port", port, 5600);
+    pn.param<std::string>("map_frame", frame, "map");
+    pn.param("target_names", target_names, std::vector<std::string>(1, "Pixel' hector"));
+
+    ros::Publisher detection_pub = n.advertise<detectssid::Detection>("wifiDetection", 1000);
+
+    detectssid::UdpLink link;
+    if(link.open_receiver((uint16_t)port) != 0){
+        fprintf(stderr, "could not open udp port %d, terminating\n", port);
+        return 1;
+    }
+    ROS_INFO("receiving detections on udp port %d", port);
+
+    std::vector<uint8_t> datagram(65536);
+    std::vector<detectssid::DetectionReport> reports;
+    std::map<uint16_t, uint16_t> next_sequence;     // per sender
+    char bssid_text[18];
+
+    while(ros::ok()){
+        int len = link.receive(datagram.data(), datagram.size(), 100);
+        if(len <= 0){
+            ros::spinOnce();
+            continue;
+        }
+
+        uint16_t sender, sequence;
+        if(detectssid::decode_detection_batch(datagram.data(), (std::size_t)len, sender, sequence, reports) != 0){
+            ROS_WARN_THROTTLE(10.0, "dropping malformed %d byte detection batch", len);
+            continue;
+        }
+
+        std::map<uint16_t, uint16_t>::iterator next = next_sequence.find(sender);
+        if(next != next_sequence.end() && sequence != next->second){
+            ROS_WARN("sender %u: lost %u detection batches", (unsigned)sender,
+                     (unsigned)(uint16_t)(sequence - next->second));
+        }
+        next_sequence[sender] = (uint16_t)(sequence + 1);
+
+        for(std::size_t i = 0; i < reports.size(); ++i){
+            const detectssid::DetectionReport& r = reports[i];
+            detectssid::Detection detection;
+            detection.header.stamp.fromSec(r.t);
+            detection.header.frame_id = frame;
+            if(r.target < target_names.size()){
+                detection.ssid = target_names[r.target];
+            }
+            detectssid::format_bssid(r.bssid, bssid_text);
+            detection.bssid = bssid_text;
+            detection.rssi = r.rssi;
+            detection.rssi_ema = NAN;
+            detection.rssi_smoothed = r.rssi_smoothed;
+            detection.rssi_variance = NAN;
+            detection.pose_valid = r.pose_valid;
+            detection.robot_pose.position.x = r.x;
+            detection.robot_pose.position.y = r.y;
+            detection.robot_pose.position.z = r.z;
+            detection.robot_pose.orientation.w = 1.0;
+            detection_pub.publish(detection);
+        }
+
+        ros::spinOnce();
+    }
+
+    return 0;
+}
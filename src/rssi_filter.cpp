@@ -0,0 +1,128 @@
+/** Per access point signal level smoothing
+ *
+ * Kalman filter for a signal level x that drifts as a random walk:
+ *
+ *   predict:  P = P + Q
+ *   update:   K = P / (P + R),  x = x + K (z - x),  P = (1 - K) P
+ *
+ * The update is applied to every slot, weighted by has_sample (0 or 1),
+ * so the loop has no data dependent branches.
+ *
+ */
+
+#include "detectssid/rssi_filter.h"
+
+#include <cmath>            // std::isnan
+
+namespace detectssid
+{
+
+RssiFilterBank::RssiFilterBank(const RssiFilterParams& params)
+    : params_(params)
+{
+}
+
+
+void RssiFilterBank::stage(uint64_t bssid, float rssi_dbm)
+{
+    if(std::isnan(rssi_dbm)){
+        return;
+    }
+
+    std::unordered_map<uint64_t, uint32_t>::iterator it = index_.find(bssid);
+    if(it != index_.end()){
+        sample_[it->second] = rssi_dbm;
+        has_sample_[it->second] = 1.0f;
+        age_[it->second] = 0;
+        return;
+    }
+
+    // new slot starts at the sample, update() must not count it twice
+    index_[bssid] = (uint32_t)bssid_.size();
+    bssid_.push_back(bssid);
+    sample_.push_back(rssi_dbm);
+    has_sample_.push_back(0.0f);
+    ema_.push_back(rssi_dbm);
+    x_.push_back(rssi_dbm);
+    p_.push_back(params_.measurement_noise - params_.process_noise);
+    age_.push_back(0);
+}
+
+
+void RssiFilterBank::update()
+{
+    const std::size_t n = bssid_.size();
+    const float alpha = params_.ema_alpha;
+    const float q = params_.process_noise;
+    const float r = params_.measurement_noise;
+
+    const float* __restrict z = sample_.data();
+    float* __restrict m = has_sample_.data();
+    float* __restrict ema = ema_.data();
+    float* __restrict x = x_.data();
+    float* __restrict p = p_.data();
+
+    for(std::size_t i = 0; i < n; ++i){
+        float p_pred = p[i] + q;
+        float k = m[i] * p_pred / (p_pred + r);
+        x[i] += k * (z[i] - x[i]);
+        p[i] = (1.0f - k) * p_pred;
+        ema[i] += m[i] * alpha * (z[i] - ema[i]);
+        m[i] = 0.0f;
+    }
+
+    // aging is kept out of the sweep above, it is rare for a slot to expire
+    for(std::size_t i = 0; i < bssid_.size(); ){
+        if(++age_[i] > params_.max_age){
+            remove_slot(i);
+        }
+        else{
+            ++i;
+        }
+    }
+}
+
+
+bool RssiFilterBank::estimate(uint64_t bssid, RssiEstimate& out) const
+{
+    std::unordered_map<uint64_t, uint32_t>::const_iterator it = index_.find(bssid);
+    if(it == index_.end()){
+        return false;
+    }
+
+    std::size_t i = it->second;
+    out.raw = sample_[i];
+    out.ema = ema_[i];
+    out.smoothed = x_[i];
+    out.variance = p_[i];
+    return true;
+}
+
+
+void RssiFilterBank::remove_slot(std::size_t slot)
+{
+    // move the last slot into the hole so the arrays stay dense
+    std::size_t last = bssid_.size() - 1;
+    index_.erase(bssid_[slot]);
+
+    if(slot != last){
+        bssid_[slot] = bssid_[last];
+        sample_[slot] = sample_[last];
+        has_sample_[slot] = has_sample_[last];
+        ema_[slot] = ema_[last];
+        x_[slot] = x_[last];
+        p_[slot] = p_[last];
+        age_[slot] = age_[last];
+        index_[bssid_[slot]] = (uint32_t)slot;
+    }
+
+    bssid_.pop_back();
+    sample_.pop_back();
+    has_sample_.pop_back();
+    ema_.pop_back();
+    x_.pop_back();
+    p_.pop_back();
+    age_.pop_back();
+}
+
+} // namespace detectssid
@@ -0,0 +1,140 @@
+/** Sparse signal strength map
+ */
+
+#include "detectssid/rssi_heatmap.h"
+
+#include <cmath>            // floor
+
+namespace detectssid
+{
+
+namespace
+{
+
+/// floor division for negative cell indices
+int32_t floor_div(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    if((a % b != 0) && ((a < 0) != (b < 0))){
+        --q;
+    }
+    return (int32_t)q;
+}
+
+} // namespace
+
+
+RssiHeatmap::RssiHeatmap(const HeatmapParams& params)
+    : params_(params), updates_(0)
+{
+    if(params_.tile_cells < 1){
+        params_.tile_cells = 1;
+    }
+    if(params_.max_tiles < 1){
+        params_.max_tiles = 1;
+    }
+}
+
+
+uint64_t RssiHeatmap::key(int32_t tx, int32_t ty, int32_t tz)
+{
+    // 21 bits per axis covers +-1M tiles, far more than any course
+    const uint64_t mask = (1ULL << 21) - 1;
+    return ((uint64_t)tx & mask) << 42 | ((uint64_t)ty & mask) << 21 | ((uint64_t)tz & mask);
+}
+
+
+HeatmapTile& RssiHeatmap::tile(int32_t tx, int32_t ty, int32_t tz)
+{
+    uint64_t k = key(tx, ty, tz);
+    std::unordered_map<uint64_t, HeatmapTile>::iterator it = tiles_.find(k);
+    if(it != tiles_.end()){
+        return it->second;
+    }
+
+    if(tiles_.size() >= params_.max_tiles){
+        evict_oldest();
+    }
+
+    HeatmapTile& t = tiles_[k];
+    t.tx = tx;
+    t.ty = ty;
+    t.tz = tz;
+    t.dirty = false;
+    t.last_update = 0;
+    HeatmapCell empty = { 0.0f, -INFINITY, 0 };
+    t.cells.assign(params_.tile_cells * params_.tile_cells, empty);
+    return t;
+}
+
+
+void RssiHeatmap::evict_oldest()
+{
+    // linear scan, only runs once the map is full
+    std::unordered_map<uint64_t, HeatmapTile>::iterator oldest = tiles_.begin();
+    for(std::unordered_map<uint64_t, HeatmapTile>::iterator it = tiles_.begin(); it != tiles_.end(); ++it){
+        if(it->second.last_update < oldest->second.last_update){
+            oldest = it;
+        }
+    }
+    if(oldest != tiles_.end()){
+        tiles_.erase(oldest);
+    }
+}
+
+
+void RssiHeatmap::add(double x, double y, double z, float rssi)
+{
+    if(std::isnan(rssi)){
+        return;
+    }
+
+    const int64_t n = params_.tile_cells;
+    int64_t cx = (int64_t)std::floor(x / params_.resolution);
+    int64_t cy = (int64_t)std::floor(y / params_.resolution);
+    int32_t tz = params_.z_resolution > 0.0 ? (int32_t)std::floor(z / params_.z_resolution) : 0;
+    int32_t tx = floor_div(cx, n);
+    int32_t ty = floor_div(cy, n);
+
+    HeatmapTile& t = tile(tx, ty, tz);
+    HeatmapCell& cell = t.cells[(cy - (int64_t)ty * n) * n + (cx - (int64_t)tx * n)];
+
+    ++cell.count;
+    cell.mean += (rssi - cell.mean) / (float)cell.count;
+    if(rssi > cell.max){
+        cell.max = rssi;
+    }
+
+    t.last_update = ++updates_;
+    if(!t.dirty){
+        t.dirty = true;
+        dirty_.push_back(key(tx, ty, tz));
+    }
+}
+
+
+void RssiHeatmap::take_dirty(std::vector<const HeatmapTile*>& tiles)
+{
+    tiles.clear();
+
+    for(std::size_t i = 0; i < dirty_.size(); ++i){
+        // the tile may have been evicted since it was marked
+        std::unordered_map<uint64_t, HeatmapTile>::iterator it = tiles_.find(dirty_[i]);
+        if(it != tiles_.end() && it->second.dirty){
+            it->second.dirty = false;
+            tiles.push_back(&it->second);
+        }
+    }
+    dirty_.clear();
+}
+
+
+void RssiHeatmap::tile_origin(const HeatmapTile& tile, double& x, double& y, double& z) const
+{
+    double side = params_.resolution * params_.tile_cells;
+    x = tile.tx * side;
+    y = tile.ty * side;
+    z = tile.tz * params_.z_resolution;
+}
+
+} // namespace detectssid
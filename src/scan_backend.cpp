@@ -0,0 +1,373 @@
+/** Sources of scan results
+ */
+
+#include "detectssid/scan_backend.h"
+
+#include <algorithm>        // min
+#include <cerrno>
+#include <cmath>            // sqrt, floor
+#include <cstdio>           // fprintf
+#include <cstring>          // memset, strerror
+#include <thread>           // sleep_until
+#include <time.h>           // clock_gettime
+#include <arpa/inet.h>      // htons
+#include <linux/if_ether.h> // ETH_P_ALL
+#include <linux/if_packet.h>
+#include <net/if.h>         // if_nametoindex
+#include <poll.h>
+#include <sys/mman.h>       // mmap
+#include <sys/socket.h>
+#include <unistd.h>         // close
+#include "rosgraph_msgs/Clock.h"
+
+namespace detectssid
+{
+
+void IwlistBackend::configure(const ScanConfig& config)
+{
+    plan_ = config.plan;
+}
+
+
+int IwlistBackend::scan(ros::Time& scan_done)
+{
+    int rc = plan_->scan();
+    scan_done = ros::Time::now();
+    return rc;
+}
+
+
+int IwlistBackend::scan_cached(ros::Time& scan_done)
+{
+    int rc = plan_->scan_cached();
+    scan_done = ros::Time::now();
+    return rc;
+}
+
+
+void IwlistBackend::read(std::vector<BssRecord>& records)
+{
+    read_scan_file(plan_->ssid_filename.c_str(), text_);
+    parse_iwlist_scan(text_.data(), text_.size(), records);
+}
+
+
+ReplayBackend::ReplayBackend(double speed)
+    : speed_(speed), started_(false), finished_(true), first_ns_(0), next_ns_(0)
+{
+}
+
+
+int ReplayBackend::open(const char* filename)
+{
+    started_ = false;
+    if(recording_.open(filename) != 0){
+        finished_ = true;
+        return -1;
+    }
+    finished_ = !recording_.next(next_ns_, next_);
+    return 0;
+}
+
+
+int ReplayBackend::scan(ros::Time& scan_done)
+{
+    if(finished_){
+        return -1;
+    }
+
+    uint64_t time_ns = next_ns_;
+    records_.swap(next_);
+    if(!started_){
+        first_ns_ = time_ns;
+        start_ = std::chrono::steady_clock::now();
+        started_ = true;
+    }
+
+    // read one scan ahead, so finished() is known before the next cycle
+    finished_ = !recording_.next(next_ns_, next_);
+
+    // the scan completes when it did in the recording, scaled by speed
+    if(speed_ > 0.0 && time_ns > first_ns_){
+        std::chrono::nanoseconds offset((int64_t)((time_ns - first_ns_) / speed_));
+        std::this_thread::sleep_until(start_ + offset);
+    }
+
+    scan_done.fromNSec(time_ns);
+    return 0;
+}
+
+
+void ReplayBackend::read(std::vector<BssRecord>& records)
+{
+    records.swap(records_);
+}
+
+MonitorBackend::MonitorBackend(double window)
+    : window_(window), fd_(-1), ring_(NULL), block_size_(1 << 20), block_count_(8), next_block_(0)
+{
+}
+
+
+MonitorBackend::~MonitorBackend()
+{
+    if(ring_ != NULL){
+        munmap(ring_, block_size_ * block_count_);
+    }
+    if(fd_ >= 0){
+        close(fd_);
+    }
+}
+
+
+int MonitorBackend::open(const char* ifname)
+{
+    unsigned int ifindex = if_nametoindex(ifname);
+    if(ifindex == 0){
+        fprintf(stderr, "no interface %s\n", ifname);
+        return -1;
+    }
+
+    fd_ = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ETH_P_ALL));
+    if(fd_ < 0){
+        fprintf(stderr, "could not open packet socket, errno: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // blocks are handed over full, or after 50 ms so a quiet channel still gets through
+    int version = TPACKET_V3;
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = block_size_;
+    req.tp_block_nr = block_count_;
+    req.tp_frame_size = 2048;
+    req.tp_frame_nr = block_size_ * block_count_ / req.tp_frame_size;
+    req.tp_retire_blk_tov = 50;
+    if(setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0
+       || setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0){
+        fprintf(stderr, "could not set up the capture ring, errno: %s\n", strerror(errno));
+        return -1;
+    }
+
+    void* p = mmap(NULL, block_size_ * block_count_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if(p == MAP_FAILED){
+        fprintf(stderr, "could not map the capture ring, errno: %s\n", strerror(errno));
+        return -1;
+    }
+    ring_ = (uint8_t*)p;
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = (int)ifindex;
+    if(bind(fd_, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+        fprintf(stderr, "could not bind to %s, errno: %s\n", ifname, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
+int MonitorBackend::open_capture(const char* prefix, std::size_t max_file_bytes, int max_files)
+{
+    return capture_.open(prefix, max_file_bytes, max_files);
+}
+
+
+void MonitorBackend::drain_block(uint8_t* block)
+{
+    struct tpacket_block_desc* desc = (struct tpacket_block_desc*)block;
+    uint8_t* frame = block + desc->hdr.bh1.offset_to_first_pkt;
+
+    for(uint32_t i = 0; i < desc->hdr.bh1.num_pkts; ++i){
+        struct tpacket3_hdr* hdr = (struct tpacket3_hdr*)frame;
+        const uint8_t* data = frame + hdr->tp_mac;
+        uint64_t time_ns = (uint64_t)hdr->tp_sec * 1000000000u + hdr->tp_nsec;
+
+        beacons_.add(time_ns, data, hdr->tp_snaplen);
+        if(capture_.is_open()){
+            capture_.write(time_ns, data, hdr->tp_snaplen, hdr->tp_len);
+        }
+        frame += hdr->tp_next_offset;
+    }
+}
+
+
+int MonitorBackend::scan(ros::Time& scan_done)
+{
+    if(ring_ == NULL){
+        return -1;
+    }
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now()
+        + std::chrono::microseconds((int64_t)(window_ * 1e6));
+    for(;;){
+        struct tpacket_block_desc* desc = (struct tpacket_block_desc*)(ring_ + next_block_ * block_size_);
+        if(desc->hdr.bh1.block_status & TP_STATUS_USER){
+            drain_block((uint8_t*)desc);
+
+            // the frames are read, the block goes back to the kernel
+            __sync_synchronize();
+            desc->hdr.bh1.block_status = TP_STATUS_KERNEL;
+            next_block_ = (next_block_ + 1) % block_count_;
+            continue;
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(now >= end){
+            break;
+        }
+        struct pollfd pfd;
+        pfd.fd = fd_;
+        pfd.events = POLLIN | POLLERR;
+        pfd.revents = 0;
+        poll(&pfd, 1, (int)std::chrono::duration_cast<std::chrono::milliseconds>(end - now).count() + 1);
+    }
+
+    // frame times are wall clock
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    beacons_.take((uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec, records_);
+    scan_done = ros::Time::now();
+    return 0;
+}
+
+
+void MonitorBackend::read(std::vector<BssRecord>& records)
+{
+    records.swap(records_);
+}
+
+
+PcapBackend::PcapBackend(double window)
+    : window_(window), finished_(true)
+{
+}
+
+
+int PcapBackend::open(const char* filename)
+{
+    if(reader_.open(filename) != 0){
+        finished_ = true;
+        return -1;
+    }
+    finished_ = !reader_.next(packet_);
+    return 0;
+}
+
+
+int PcapBackend::scan(ros::Time& scan_done)
+{
+    if(finished_){
+        return -1;
+    }
+
+    // one window of capture time, no waiting
+    uint64_t end_ns = packet_.time_ns + (uint64_t)(window_ * 1e9);
+    do{
+        if(packet_.link_type == kLinkTypeRadiotap){
+            beacons_.add(packet_.time_ns, packet_.data, packet_.len);
+        }
+        finished_ = !reader_.next(packet_);
+    } while(!finished_ && packet_.time_ns < end_ns);
+
+    beacons_.take(end_ns, records_);
+    scan_done.fromNSec(end_ns);
+    return 0;
+}
+
+
+void PcapBackend::read(std::vector<BssRecord>& records)
+{
+    records.swap(records_);
+}
+
+SimulatorBackend::SimulatorBackend(const SimulatorParams& params, const std::vector<SimulatedNetwork>& networks,
+                                   const PoseHistory* poses, ros::NodeHandle& n)
+    : params_(params), networks_(networks), poses_(poses), rng_(params.seed)
+{
+    if(params_.own_clock){
+        if(!ros::Time::isSimTime()){
+            ROS_WARN("sim_own_clock is set without /use_sim_time, other nodes will not follow the clock");
+        }
+        clock_pub_ = n.advertise<rosgraph_msgs::Clock>("/clock", 10);
+        clock_ = ros::Time::now();
+        if(clock_.isZero()){
+            clock_ = ros::Time(1, 0);
+        }
+    }
+}
+
+
+int SimulatorBackend::scan(ros::Time& scan_done)
+{
+    std::uniform_real_distribution<double> jitter(-params_.scan_jitter, params_.scan_jitter);
+    ros::Duration length(std::max(0.0, params_.scan_time + jitter(rng_)));
+
+    // the scan takes its time on the ROS clock, simulated or not
+    ros::Time start;
+    if(params_.own_clock){
+        start = clock_;
+        clock_ += length;
+        ros::Time::setNow(clock_);
+        rosgraph_msgs::Clock clock;
+        clock.clock = clock_;
+        clock_pub_.publish(clock);
+        scan_done = clock_;
+    }
+    else{
+        start = ros::Time::now();
+        length.sleep();
+        scan_done = ros::Time::now();
+    }
+    double scan_length = (scan_done - start).toSec();
+
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    // sim_shadowing 0 asks for none, and is out of the distribution's domain
+    const bool shadowed = params_.path_loss.sigma > 0.0;
+    std::normal_distribution<double> shadowing(0.0, shadowed ? params_.path_loss.sigma : 1.0);
+    records_.clear();
+    for(std::size_t i = 0; i < networks_.size(); ++i){
+        const SimulatedNetwork& network = networks_[i];
+
+        // heard once, at a random moment of the scan, from where the robot was then
+        double age = uniform(rng_) * scan_length;
+        PoseSample pose;
+        if(poses_ == NULL || !poses_->lookup(scan_done.toSec() - age, pose)){
+            pose.x = params_.robot_x;
+            pose.y = params_.robot_y;
+            pose.z = params_.robot_z;
+        }
+
+        double dx = network.x - pose.x;
+        double dy = network.y - pose.y;
+        double dz = network.z - pose.z;
+        double rssi = params_.path_loss.expected_rssi(std::sqrt(dx * dx + dy * dy + dz * dz));
+        if(shadowed){
+            rssi += shadowing(rng_);
+        }
+        if(rssi < params_.sensitivity || uniform(rng_) < params_.dropout){
+            continue;
+        }
+
+        // whole dBm like the drivers report
+        BssRecord bss;
+        bss.bssid = network.bssid;
+        bss.signal_dbm = (float)std::floor(rssi + 0.5);
+        bss.last_seen_ms = (float)(age * 1e3);
+        bss.ssid_len = (uint8_t)std::min(network.ssid.size(), kMaxSsidText);
+        memcpy(bss.ssid, network.ssid.data(), bss.ssid_len);
+        bss.ssid[bss.ssid_len] = '\0';
+        records_.push_back(bss);
+    }
+    return 0;
+}
+
+
+void SimulatorBackend::read(std::vector<BssRecord>& records)
+{
+    records.swap(records_);
+}
+
+} // namespace detectssid
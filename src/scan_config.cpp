@@ -0,0 +1,253 @@
+/** Scan settings that can change while the detector runs
+ */
+
+#include "detectssid/scan_config.h"
+
+#include <fcntl.h>          // open
+#include <sys/wait.h>       // waitpid
+#include <unistd.h>         // fork, execvp, pipe2
+
+#include <algorithm>        // min
+#include <cerrno>
+#include <cstdio>           // fprintf
+#include <cstring>          // memchr, memmem, strerror
+
+namespace detectssid
+{
+
+namespace
+{
+
+/// the lines of an iwlist scan the parser reads, see parse_iwlist_scan()
+const char* const kScanKeys[] = { "Address", "ESSID", "Signal level", "Last beacon" };
+
+bool wanted_line(const char* line, std::size_t len)
+{
+    for(std::size_t i = 0; i < sizeof(kScanKeys) / sizeof(kScanKeys[0]); ++i){
+        if(memmem(line, len, kScanKeys[i], strlen(kScanKeys[i])) != NULL){
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @brief Runs iwlist and keeps the wanted lines of its output in filename
+ *
+ * Same as iwlist ... | grep -E 'Address|ESSID|Signal level|Last beacon' > filename
+ * without a shell. No allocation, it runs every scan cycle.
+ *
+ * @param[in] argv - iwlist and its arguments, NULL terminated
+ *
+ * @return 0 upon success, -1 upon failure
+ */
+int run_iwlist(char* const argv[], const char* filename)
+{
+    int out = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(out < 0){
+        fprintf(stderr, "could not write %s, errno: %s\n", filename, strerror(errno));
+        return -1;
+    }
+
+    int pipe_fds[2];
+    if(pipe2(pipe_fds, O_CLOEXEC) != 0){
+        fprintf(stderr, "could not run iwlist, errno: %s\n", strerror(errno));
+        close(out);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if(pid == 0){
+        // dup2 clears close on exec of stdout only
+        if(dup2(pipe_fds[1], STDOUT_FILENO) < 0){
+            _exit(127);
+        }
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    close(pipe_fds[1]);
+    if(pid < 0){
+        fprintf(stderr, "could not run iwlist, errno: %s\n", strerror(errno));
+        close(pipe_fds[0]);
+        close(out);
+        return -1;
+    }
+
+    // whole lines only, the wanted ones are short; longer lines are dropped
+    char chunk[4096];
+    char line[512];
+    std::size_t line_len = 0;
+    bool too_long = false;
+    int rc = 0;
+    ssize_t n;
+    while((n = read(pipe_fds[0], chunk, sizeof(chunk))) != 0){
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            // a truncated scan is not parsed as a complete one, the file is left empty
+            fprintf(stderr, "could not read the iwlist output, errno: %s\n", strerror(errno));
+            if(ftruncate(out, 0) != 0){
+                fprintf(stderr, "could not empty %s, errno: %s\n", filename, strerror(errno));
+            }
+            rc = -1;
+            break;
+        }
+        const char* p = chunk;
+        const char* end = chunk + n;
+        while(p < end){
+            const char* eol = (const char*)memchr(p, '\n', end - p);
+            std::size_t len = (eol != NULL ? eol + 1 : end) - p;
+            if(line_len + len > sizeof(line)){
+                too_long = true;
+            }
+            else{
+                memcpy(line + line_len, p, len);
+                line_len += len;
+            }
+            p += len;
+            if(eol != NULL){
+                if(!too_long && wanted_line(line, line_len) && write(out, line, line_len) != (ssize_t)line_len){
+                    rc = -1;
+                }
+                line_len = 0;
+                too_long = false;
+            }
+        }
+    }
+    close(pipe_fds[0]);
+    if(close(out) != 0){
+        rc = -1;
+    }
+
+    int status;
+    while(waitpid(pid, &status, 0) < 0){
+        if(errno != EINTR){
+            return -1;
+        }
+    }
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        rc = -1;
+    }
+    return rc;
+}
+
+} // namespace
+
+
+TargetMatcher::TargetMatcher(const std::string& target)
+    : target_(target)
+{
+    std::size_t m = target_.size();
+    for(int c = 0; c < 256; ++c){
+        skip_[c] = m;
+    }
+    for(std::size_t i = 0; i + 1 < m; ++i){
+        skip_[(unsigned char)target_[i]] = m - 1 - i;
+    }
+}
+
+
+const char* TargetMatcher::find(const char* text, std::size_t len) const
+{
+    std::size_t m = target_.size();
+    if(m == 0){
+        return text;
+    }
+
+    const char* last = target_.data() + m - 1;
+    for(std::size_t pos = 0; pos + m <= len; pos += skip_[(unsigned char)text[pos + m - 1]]){
+        // compare from the end, the skip table is indexed by the last character
+        const char* t = text + pos + m - 1;
+        const char* p = last;
+        while(*t == *p){
+            if(p == target_.data()){
+                return t;
+            }
+            --t;
+            --p;
+        }
+    }
+    return text + len;
+}
+
+
+bool TargetMatcher::search(const std::vector<BssRecord>& records, std::string& network,
+                           std::size_t& match_index) const
+{
+    network.clear();
+
+    for(std::size_t i = match_index; i < records.size(); ++i){
+        const BssRecord& bss = records[i];
+        const char* end = bss.ssid + bss.ssid_len;
+        const char* found = find(bss.ssid, bss.ssid_len);
+        if(found != end){
+            // add 2 for XX, two digit randomized number
+            std::size_t n = std::min<std::size_t>(target_.size() + 2, end - found);
+            network.assign(found, n);
+            match_index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+ScanPlan::ScanPlan(const std::string& interface_name, const std::string& filename)
+    : ifname(interface_name), ssid_filename(filename)
+{
+}
+
+
+int ScanPlan::scan() const
+{
+    char* argv[] = { const_cast<char*>("iwlist"), const_cast<char*>(ifname.c_str()),
+                     const_cast<char*>("scan"), NULL };
+    if(ifname.empty()){
+        argv[1] = argv[2];
+        argv[2] = NULL;
+    }
+    return run_iwlist(argv, ssid_filename.c_str());
+}
+
+
+int ScanPlan::scan_cached() const
+{
+    if(ifname.empty()){
+        return -1;
+    }
+    char* argv[] = { const_cast<char*>("iwlist"), const_cast<char*>(ifname.c_str()),
+                     const_cast<char*>("scan"), const_cast<char*>("last"), NULL };
+    return run_iwlist(argv, ssid_filename.c_str());
+}
+
+
+std::shared_ptr<const ScanConfig> make_scan_config(const std::shared_ptr<const ScanConfig>& previous,
+                                                   const std::string& target, const std::string& ifname,
+                                                   const std::string& ssid_filename,
+                                                   double loop_rate, int queue_size)
+{
+    std::shared_ptr<ScanConfig> config(new ScanConfig);
+
+    if(previous && previous->matcher->target() == target){
+        config->matcher = previous->matcher;
+    }
+    else{
+        config->matcher.reset(new TargetMatcher(target));
+    }
+
+    if(previous && previous->plan->ifname == ifname && previous->plan->ssid_filename == ssid_filename){
+        config->plan = previous->plan;
+    }
+    else{
+        config->plan.reset(new ScanPlan(ifname, ssid_filename));
+    }
+
+    config->loop_rate = loop_rate;
+    config->queue_size = queue_size;
+    return config;
+}
+
+} // namespace detectssid
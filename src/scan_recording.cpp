@@ -0,0 +1,272 @@
+/** Recording of the scan results
+ */
+
+#include "detectssid/scan_recording.h"
+#include "detectssid/byte_order.h"
+#include "detectssid/crc32.h"
+
+#include <cerrno>
+#include <cstdio>           // fprintf
+#include <cstring>          // memcpy, memcmp, memset, strerror
+#include <fcntl.h>          // open
+#include <sys/mman.h>       // mmap, msync
+#include <sys/stat.h>       // fstat
+#include <unistd.h>         // ftruncate, close
+
+namespace detectssid
+{
+
+namespace
+{
+
+const char kMagic[8] = { 'D', 'S', 'S', 'I', 'D', 'S', 'R', '1' };
+const std::size_t kHeaderSize = 16;
+const std::size_t kScanHeaderSize = 20;
+const std::size_t kRecordHeaderSize = 15;
+
+void put_float(uint8_t* p, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_le(p, bits, 4);
+}
+
+float get_float(const uint8_t* p)
+{
+    uint32_t bits = (uint32_t)get_le(p, 4);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+} // namespace
+
+
+ScanRecorder::ScanRecorder()
+    : fd_(-1), base_(NULL), capacity_(0), end_(0)
+{
+}
+
+
+ScanRecorder::~ScanRecorder()
+{
+    close();
+}
+
+
+int ScanRecorder::map(std::size_t capacity)
+{
+    if(ftruncate(fd_, (off_t)capacity) != 0){
+        fprintf(stderr, "could not size scan recording, errno: %s\n", strerror(errno));
+        return -1;
+    }
+    void* p = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if(p == MAP_FAILED){
+        fprintf(stderr, "could not map scan recording, errno: %s\n", strerror(errno));
+        return -1;
+    }
+    base_ = (uint8_t*)p;
+    capacity_ = capacity;
+    return 0;
+}
+
+
+int ScanRecorder::open(const char* filename, std::size_t capacity)
+{
+    close();
+
+    fd_ = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd_ < 0){
+        fprintf(stderr, "could not open %s, errno: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    if(capacity < 4096){
+        capacity = 4096;
+    }
+    if(map(capacity) != 0){
+        close();
+        return -1;
+    }
+
+    memset(base_, 0, kHeaderSize);
+    memcpy(base_, kMagic, sizeof(kMagic));
+    end_ = kHeaderSize;
+    return 0;
+}
+
+
+void ScanRecorder::close()
+{
+    if(base_ != NULL){
+        msync(base_, capacity_, MS_SYNC);
+        munmap(base_, capacity_);
+        base_ = NULL;
+    }
+    if(fd_ >= 0){
+        // no zero tail in a finished recording
+        if(end_ > 0 && ftruncate(fd_, (off_t)end_) != 0){
+            fprintf(stderr, "could not trim scan recording, errno: %s\n", strerror(errno));
+        }
+        ::close(fd_);
+        fd_ = -1;
+    }
+    capacity_ = 0;
+    end_ = 0;
+}
+
+
+int ScanRecorder::append(uint64_t time_ns, const std::vector<BssRecord>& records)
+{
+    if(base_ == NULL){
+        return -1;
+    }
+
+    std::size_t count = records.size() < 0xffff ? records.size() : 0xffff;
+    std::size_t len = kScanHeaderSize;
+    for(std::size_t i = 0; i < count; ++i){
+        len += kRecordHeaderSize + records[i].ssid_len;
+    }
+
+    // grow by doubling, the mapping moves
+    if(end_ + len > capacity_){
+        std::size_t capacity = capacity_;
+        while(end_ + len > capacity){
+            capacity *= 2;
+        }
+        munmap(base_, capacity_);
+        base_ = NULL;
+        if(map(capacity) != 0){
+            return -1;
+        }
+    }
+
+    uint8_t* p = base_ + end_;
+    put_le(p + 4, len - 8, 4);
+    put_le(p + 8, time_ns, 8);
+    put_le(p + 16, count, 2);
+    put_le(p + 18, 0, 2);
+
+    uint8_t* out = p + kScanHeaderSize;
+    for(std::size_t i = 0; i < count; ++i){
+        const BssRecord& bss = records[i];
+        put_le(out, bss.bssid, 6);
+        put_float(out + 6, bss.signal_dbm);
+        put_float(out + 10, bss.last_seen_ms);
+        out[14] = bss.ssid_len;
+        memcpy(out + kRecordHeaderSize, bss.ssid, bss.ssid_len);
+        out += kRecordHeaderSize + bss.ssid_len;
+    }
+
+    // checksum last, a scan is complete once it matches
+    put_le(p, crc32(p + 4, len - 4), 4);
+    end_ += len;
+    return 0;
+}
+
+
+ScanRecording::ScanRecording()
+    : base_(NULL), size_(0), offset_(0)
+{
+}
+
+
+ScanRecording::~ScanRecording()
+{
+    close();
+}
+
+
+int ScanRecording::open(const char* filename)
+{
+    close();
+
+    int fd = ::open(filename, O_RDONLY);
+    if(fd < 0){
+        fprintf(stderr, "could not open %s, errno: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)kHeaderSize){
+        fprintf(stderr, "%s is not a scan recording\n", filename);
+        ::close(fd);
+        return -1;
+    }
+
+    void* p = mmap(NULL, (std::size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(p == MAP_FAILED){
+        fprintf(stderr, "could not map %s, errno: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    base_ = (const uint8_t*)p;
+    size_ = (std::size_t)st.st_size;
+
+    if(memcmp(base_, kMagic, sizeof(kMagic)) != 0){
+        fprintf(stderr, "%s is not a scan recording\n", filename);
+        close();
+        return -1;
+    }
+
+    // recordings are read front to back once
+    madvise((void*)base_, size_, MADV_SEQUENTIAL);
+    offset_ = kHeaderSize;
+    return 0;
+}
+
+
+void ScanRecording::close()
+{
+    if(base_ != NULL){
+        munmap((void*)base_, size_);
+        base_ = NULL;
+    }
+    size_ = 0;
+    offset_ = 0;
+}
+
+
+void ScanRecording::rewind()
+{
+    offset_ = kHeaderSize;
+}
+
+
+bool ScanRecording::next(uint64_t& time_ns, std::vector<BssRecord>& records)
+{
+    if(base_ == NULL || offset_ + kScanHeaderSize > size_){
+        return false;
+    }
+
+    const uint8_t* p = base_ + offset_;
+    std::size_t len = (std::size_t)get_le(p + 4, 4) + 8;
+    if(len < kScanHeaderSize || offset_ + len > size_ || get_le(p, 4) != crc32(p + 4, len - 4)){
+        return false;       // end of a recording cut short
+    }
+
+    time_ns = get_le(p + 8, 8);
+    std::size_t count = (std::size_t)get_le(p + 16, 2);
+    records.resize(count);
+
+    const uint8_t* in = p + kScanHeaderSize;
+    const uint8_t* end = p + len;
+    for(std::size_t i = 0; i < count; ++i){
+        if(in + kRecordHeaderSize > end || in + kRecordHeaderSize + in[14] > end){
+            records.resize(i);
+            break;
+        }
+        BssRecord& bss = records[i];
+        bss.bssid = get_le(in, 6);
+        bss.signal_dbm = get_float(in + 6);
+        bss.last_seen_ms = get_float(in + 10);
+        std::size_t n = in[14] < kMaxSsidText ? in[14] : kMaxSsidText;
+        memcpy(bss.ssid, in + kRecordHeaderSize, n);
+        bss.ssid[n] = '\0';
+        bss.ssid_len = (uint8_t)n;
+        in += kRecordHeaderSize + in[14];
+    }
+
+    offset_ += len;
+    return true;
+}
+
+} // namespace detectssid
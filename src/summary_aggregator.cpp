@@ -0,0 +1,166 @@
+/** Merge the phone observation summaries of several robots
+ *
+ *  Purpose: runs on the base station. Every robot publishes the changed
+ *  voxels of its own summary (see SummaryStore), relayed over the mesh
+ *  in any order and possibly more than once. Each robot's copy of a
+ *  voxel is kept separately and replaced only by a copy with a larger
+ *  count, so repeated or stale summaries are never counted twice; the
+ *  merged view sums the robots' copies. Every run of a robot's detector
+ *  has its own incarnation and is kept as a copy of its own, so the
+ *  counts a restarted detector begins again from 0 are added.
+ *
+ *  Subscribes to every topic in ~summary_topics, publishes the merged
+ *  view as merged_summary (robot_id "merged", always full) at ~rate
+ *  when it changed.
+ *
+ */
+
+#include <cstdio>           // fprintf
+#include <map>
+#include <string>
+#include <vector>
+#include "ros/ros.h"
+
+#include "detectssid/ObservationSummary.h"
+#include "detectssid/bss.h"
+#include "detectssid/observation_summary.h"
+
+
+/**
+ * @brief Merges incoming summaries into one view
+ */
+struct SummaryMerger
+{
+    detectssid::SummaryAggregator aggregator;
+    std::map<uint64_t, std::string> ssids;
+    float voxel_size;
+    float z_voxel_size;
+    bool changed;
+
+    void on_summary(const detectssid::ObservationSummary::ConstPtr& summary)
+    {
+        if(summary->robot_id.empty()){
+            ROS_WARN_THROTTLE(10.0, "dropping observation summary without robot_id");
+            return;
+        }
+
+        // voxel indices of different sizes cannot be merged
+        if(voxel_size == 0.0f){
+            voxel_size = summary->voxel_size;
+            z_voxel_size = summary->z_voxel_size;
+        }
+        else if(summary->voxel_size != voxel_size || summary->z_voxel_size != z_voxel_size){
+            ROS_WARN_THROTTLE(10.0, "dropping summary of %s: voxel size %.2f x %.2f, expected %.2f x %.2f",
+                              summary->robot_id.c_str(), summary->voxel_size, summary->z_voxel_size,
+                              voxel_size, z_voxel_size);
+            return;
+        }
+
+        for(std::size_t t = 0; t < summary->targets.size(); ++t){
+            const detectssid::TargetSummary& target = summary->targets[t];
+            detectssid::VoxelKey key;
+            if(!detectssid::parse_bssid(target.bssid.c_str(), target.bssid.size(), key.target)){
+                continue;
+            }
+            if(!target.ssid.empty()){
+                ssids[key.target] = target.ssid;
+            }
+
+            for(std::size_t v = 0; v < target.voxels.size(); ++v){
+                const detectssid::VoxelSummary& voxel = target.voxels[v];
+                key.x = voxel.x;
+                key.y = voxel.y;
+                key.z = voxel.z;
+                detectssid::VoxelStatistics stats;
+                stats.count = voxel.count;
+                stats.sum = voxel.sum;
+                stats.sum_sq = voxel.sum_sq;
+                stats.max = voxel.max;
+                if(aggregator.merge(summary->robot_id, summary->incarnation, key, stats)){
+                    changed = true;
+                }
+            }
+        }
+    }
+};
+
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "summary_aggregator");
+    ros::NodeHandle n;
+    ros::NodeHandle pn("~");
+
+    std::vector<std::string> topics;
+    std::string frame;
+    double rate;
+    pn.param("summary_topics", topics, std::vector<std::string>(1, "observation_summary"));
+    pn.param<std::string>("map_frame", frame, "map");
+    pn.param("rate", rate, 1.0);
+
+    SummaryMerger merger;
+    merger.voxel_size = 0.0f;
+    merger.z_voxel_size = 0.0f;
+    merger.changed = false;
+
+    std::vector<ros::Subscriber> subscribers;
+    for(std::size_t i = 0; i < topics.size(); ++i){
+        subscribers.push_back(n.subscribe(topics[i], 100, &SummaryMerger::on_summary, &merger));
+    }
+    ros::Publisher merged_pub = n.advertise<detectssid::ObservationSummary>("merged_summary", 10, true);
+
+    std::vector<detectssid::VoxelEntry> totals;
+    std::map<uint64_t, std::size_t> target_index;
+    ros::Rate loop_rate(rate);
+
+    while(ros::ok()){
+        ros::spinOnce();
+
+        if(merger.changed){
+            merger.changed = false;
+            merger.aggregator.totals(totals);
+
+            detectssid::ObservationSummary merged;
+            merged.header.stamp = ros::Time::now();
+            merged.header.frame_id = frame;
+            merged.robot_id = "merged";
+            merged.voxel_size = merger.voxel_size;
+            merged.z_voxel_size = merger.z_voxel_size;
+            merged.full = true;
+
+            target_index.clear();
+            for(std::size_t i = 0; i < totals.size(); ++i){
+                const detectssid::VoxelKey& key = totals[i].first;
+                const detectssid::VoxelStatistics& stats = totals[i].second;
+
+                std::map<uint64_t, std::size_t>::iterator it = target_index.find(key.target);
+                if(it == target_index.end()){
+                    it = target_index.insert(std::make_pair(key.target, merged.targets.size())).first;
+                    merged.targets.push_back(detectssid::TargetSummary());
+                    char bssid[18];
+                    detectssid::format_bssid(key.target, bssid);
+                    merged.targets.back().bssid = bssid;
+                    merged.targets.back().ssid = merger.ssids[key.target];
+                }
+
+                detectssid::VoxelSummary voxel;
+                voxel.x = key.x;
+                voxel.y = key.y;
+                voxel.z = key.z;
+                voxel.count = stats.count;
+                voxel.sum = stats.sum;
+                voxel.sum_sq = stats.sum_sq;
+                voxel.max = stats.max;
+                merged.targets[it->second].voxels.push_back(voxel);
+            }
+
+            merged_pub.publish(merged);
+            ROS_INFO("merged summaries of %zu robots in %zu runs: %zu voxels in %zu targets",
+                     merger.aggregator.robots(), merger.aggregator.replicas(), totals.size(), merged.targets.size());
+        }
+
+        loop_rate.sleep();
+    }
+
+    return 0;
+}
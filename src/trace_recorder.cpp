@@ -0,0 +1,148 @@
+/** Timeline trace of the detection pipeline
+ */
+
+#include "detectssid/trace_recorder.h"
+
+#include <cerrno>
+#include <cstring>          // strerror
+#include <pthread.h>        // pthread_getname_np
+#include <sys/syscall.h>    // SYS_gettid
+#include <unistd.h>         // getpid, syscall
+
+namespace detectssid
+{
+
+namespace
+{
+
+std::atomic<uint64_t> next_recorder_id(1);
+
+} // namespace
+
+
+TraceRecorder::TraceRecorder(std::size_t events_per_thread)
+    : id_(next_recorder_id.fetch_add(1)), capacity_(events_per_thread < 16 ? 16 : events_per_thread),
+      fp_(NULL), origin_ns_(0), dropped_(0)
+{
+}
+
+
+TraceRecorder::~TraceRecorder()
+{
+    close();
+}
+
+
+int TraceRecorder::open(const char* filename)
+{
+    close();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    fp_ = fopen(filename, "w");
+    if(fp_ == NULL){
+        fprintf(stderr, "could not write %s, errno: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    origin_ns_ = monotonic_ns();
+    fprintf(fp_, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"detectssid\"}}",
+            (int)getpid());
+    return 0;
+}
+
+
+TraceRecorder::ThreadBuffer* TraceRecorder::thread_buffer()
+{
+    // one lookup per thread and recorder, the later spans find the buffer here
+    static thread_local uint64_t cached_id = 0;
+    static thread_local ThreadBuffer* cached = NULL;
+    if(cached_id == id_){
+        return cached;
+    }
+
+    std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+    buffer->tid = (int)syscall(SYS_gettid);
+    buffer->events.resize(capacity_);
+    buffer->head.store(0, std::memory_order_relaxed);
+    buffer->tail.store(0, std::memory_order_relaxed);
+    buffer->named = false;
+    if(pthread_getname_np(pthread_self(), buffer->name, sizeof(buffer->name)) != 0){
+        buffer->name[0] = '\0';
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    cached = buffer.get();
+    cached_id = id_;
+    buffers_.push_back(std::move(buffer));
+    return cached;
+}
+
+
+void TraceRecorder::record(const char* name, uint64_t start_ns, uint64_t end_ns)
+{
+    ThreadBuffer* buffer = thread_buffer();
+
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    if(head - buffer->tail.load(std::memory_order_acquire) >= capacity_){
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Event& event = buffer->events[head % capacity_];
+    event.name = name;
+    event.start_ns = start_ns;
+    event.end_ns = end_ns;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+
+void TraceRecorder::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(fp_ == NULL){
+        return;
+    }
+
+    int pid = (int)getpid();
+    for(std::size_t i = 0; i < buffers_.size(); ++i){
+        ThreadBuffer& buffer = *buffers_[i];
+
+        if(!buffer.named){
+            // thread names end up in json, keep them to safe characters
+            for(char* c = buffer.name; *c != '\0'; ++c){
+                if(*c == '"' || *c == '\\' || (unsigned char)*c < 0x20){
+                    *c = '_';
+                }
+            }
+            fprintf(fp_, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    pid, buffer.tid, buffer.name);
+            buffer.named = true;
+        }
+
+        uint64_t tail = buffer.tail.load(std::memory_order_relaxed);
+        uint64_t head = buffer.head.load(std::memory_order_acquire);
+        for(; tail != head; ++tail){
+            const Event& event = buffer.events[tail % capacity_];
+            double ts = ((double)event.start_ns - (double)origin_ns_) * 1e-3;
+            double dur = (double)(event.end_ns - event.start_ns) * 1e-3;
+            fprintf(fp_, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    event.name, pid, buffer.tid, ts, dur);
+        }
+        buffer.tail.store(tail, std::memory_order_release);
+    }
+    fflush(fp_);
+}
+
+
+void TraceRecorder::close()
+{
+    flush();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(fp_ != NULL){
+        fprintf(fp_, "\n]\n");
+        fclose(fp_);
+        fp_ = NULL;
+    }
+}
+
+} // namespace detectssid
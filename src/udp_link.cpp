@@ -0,0 +1,157 @@
+/** Plain UDP datagram link
+ */
+
+#include "detectssid/udp_link.h"
+
+#include <cerrno>
+#include <cstdio>           // fprintf, snprintf
+#include <cstring>          // memcpy, memset, strerror
+#include <netdb.h>          // getaddrinfo
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>         // close
+
+namespace detectssid
+{
+
+UdpLink::UdpLink()
+    : fd_(-1), peer_len_(0)
+{
+    memset(&peer_, 0, sizeof(peer_));
+}
+
+
+UdpLink::~UdpLink()
+{
+    close();
+}
+
+
+void UdpLink::close()
+{
+    if(fd_ >= 0){
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+
+int UdpLink::open_sender(const char* host, uint16_t port)
+{
+    close();
+
+    char service[8];
+    snprintf(service, sizeof(service), "%u", (unsigned)port);
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    addrinfo* result = NULL;
+    int rc = getaddrinfo(host, service, &hints, &result);
+    if(rc != 0){
+        fprintf(stderr, "could not resolve %s: %s\n", host, gai_strerror(rc));
+        return -1;
+    }
+
+    for(addrinfo* ai = result; ai != NULL; ai = ai->ai_next){
+        fd_ = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(fd_ >= 0){
+            memcpy(&peer_, ai->ai_addr, ai->ai_addrlen);
+            peer_len_ = ai->ai_addrlen;
+            break;
+        }
+    }
+    freeaddrinfo(result);
+
+    if(fd_ < 0){
+        fprintf(stderr, "could not open socket to %s:%u, errno: %s\n", host, (unsigned)port, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
+int UdpLink::open_receiver(uint16_t port)
+{
+    close();
+
+    fd_ = socket(AF_INET6, SOCK_DGRAM, 0);
+    if(fd_ >= 0){
+        // accept IPv4 senders as mapped addresses as well
+        int off = 0;
+        setsockopt(fd_, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+        sockaddr_in6 addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_any;
+        addr.sin6_port = htons(port);
+        if(bind(fd_, (const sockaddr*)&addr, sizeof(addr)) == 0){
+            return 0;
+        }
+        close();
+    }
+
+    // no IPv6 support
+    fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if(fd_ >= 0){
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if(bind(fd_, (const sockaddr*)&addr, sizeof(addr)) == 0){
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "could not listen on udp port %u, errno: %s\n", (unsigned)port, strerror(errno));
+    close();
+    return -1;
+}
+
+
+int UdpLink::send(const uint8_t* data, std::size_t len)
+{
+    if(fd_ < 0){
+        return -1;
+    }
+    ssize_t sent = sendto(fd_, data, len, 0, (const sockaddr*)&peer_, peer_len_);
+    if(sent != (ssize_t)len){
+        fprintf(stderr, "could not send %zu bytes, errno: %s\n", len, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
+int UdpLink::receive(uint8_t* data, std::size_t capacity, int timeout_ms)
+{
+    if(fd_ < 0){
+        return -1;
+    }
+
+    pollfd pfd;
+    pfd.fd = fd_;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int rc = poll(&pfd, 1, timeout_ms);
+    if(rc == 0 || (rc < 0 && errno == EINTR)){
+        return 0;
+    }
+    if(rc < 0){
+        fprintf(stderr, "could not wait for datagram, errno: %s\n", strerror(errno));
+        return -1;
+    }
+
+    ssize_t len = recv(fd_, data, capacity, 0);
+    if(len < 0){
+        fprintf(stderr, "could not receive datagram, errno: %s\n", strerror(errno));
+        return -1;
+    }
+    return (int)len;
+}
+
+} // namespace detectssid
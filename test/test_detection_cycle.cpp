@@ -0,0 +1,258 @@
+/** Heap allocations of the detection cycle
+ *
+ *  Purpose: keep the heap out of the steady state detector. Every test
+ *  drives the DetectionCycle that Detector::spin_once() runs, with the
+ *  scans read by the IwlistBackend from a scan file, and counts every
+ *  malloc, operator new included, of the read and the run().
+ *
+ *  The robot drives back and forth past two phones, a calibration
+ *  transmitter and an ambient network, so the pose lookup, the peak
+ *  detector, the heatmap and summary stores, the calibrator, the message
+ *  pools and the localizer all have work in every cycle. Once the robot
+ *  has passed every place twice, a cycle must not allocate.
+ *
+ *  Run: catkin_make run_tests_detectssid
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>        // max
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>           // snprintf, remove
+#include <cstdlib>          // malloc
+#include <fstream>          // ofstream
+#include <memory>           // shared_ptr
+#include <string>
+#include <unistd.h>         // getpid
+
+#include "detectssid/detection_cycle.h"
+#include "detectssid/scan_backend.h"
+#include "detectssid/scan_config.h"
+
+/// heap allocations of the whole process, operator new included
+std::atomic<uint64_t> g_allocations(0);
+
+// glibc's own allocator under a counting malloc
+extern "C" void* __libc_malloc(std::size_t size);
+extern "C" void* __libc_calloc(std::size_t n, std::size_t size);
+extern "C" void* __libc_realloc(void* p, std::size_t size);
+
+extern "C" void* malloc(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(std::size_t n, std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* p, std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+
+namespace
+{
+
+const char kTarget[] = "PhoneArtifact";
+
+/// a network next to the robot's path
+struct Transmitter
+{
+    const char* bssid;
+    const char* ssid;
+    double x, y, z;
+};
+
+const Transmitter kPhones[] = {
+    { "02:00:00:00:00:07", "PhoneArtifact07", 5.0, 2.0, 0.0 },
+    { "02:00:00:00:00:31", "PhoneArtifact31", 15.0, -3.0, 1.0 },
+};
+const Transmitter kBeacon = { "02:00:00:00:00:c0", "calibration", 12.0, 0.0, 0.0 };
+const Transmitter kAmbient = { "02:00:00:00:00:a0", "PhoneArtifact99", 10.0, 5.0, 0.0 };
+
+/// the robot drives from x 0 to 20 m and back at 1 m per scan
+const int kPathCycles = 40;
+
+double robot_x(int cycle)
+{
+    int k = cycle % kPathCycles;
+    return k <= kPathCycles / 2 ? k : kPathCycles - k;
+}
+
+/// scan time of a cycle, seconds
+double scan_time(int cycle)
+{
+    return 1000.0 + cycle;
+}
+
+/// level of a transmitter from the robot at x, log distance path loss
+int signal_level(const Transmitter& tx, double x)
+{
+    double dx = x - tx.x;
+    double d = std::sqrt(dx * dx + tx.y * tx.y + tx.z * tx.z);
+    return (int)std::lround(-40.0 - 25.0 * std::log10(std::max(d, 1.0)));
+}
+
+/// one cell of "iwlist scan" output
+void write_cell(std::ofstream& out, int cell, const Transmitter& tx, double x)
+{
+    char line[256];
+
+    snprintf(line, sizeof(line), "          Cell %02d - Address: %s\n", cell, tx.bssid);
+    out << line;
+    snprintf(line, sizeof(line), "                    Quality=50/70  Signal level=%d dBm  \n",
+             signal_level(tx, x));
+    out << line;
+    out << "                    ESSID:\"" << tx.ssid << "\"\n";
+    out << "                    Extra: Last beacon: 100ms ago\n";
+}
+
+/// the scan file of a cycle, written before the count starts
+void write_scan(const char* filename, int cycle)
+{
+    double x = robot_x(cycle);
+    std::ofstream out(filename);
+    int cell = 1;
+
+    write_cell(out, cell++, kBeacon, x);
+    write_cell(out, cell++, kAmbient, x);
+    for(std::size_t i = 0; i < sizeof(kPhones) / sizeof(kPhones[0]); ++i){
+        write_cell(out, cell++, kPhones[i], x);
+    }
+}
+
+/// the robot poses up to the scan of a cycle, as the pose sampler records them
+void push_poses(detectssid::PoseHistory& history, int cycle)
+{
+    for(int i = 1; i <= 4; ++i){
+        double f = i / 4.0;
+        detectssid::PoseSample pose = detectssid::PoseSample();
+        pose.t = scan_time(cycle - 1) + f;
+        pose.x = robot_x(cycle - 1) + f * (robot_x(cycle) - robot_x(cycle - 1));
+        pose.qw = 1.0;
+        history.push(pose);
+    }
+}
+
+/// counts the messages, keeps none
+struct CountingSink : public detectssid::DetectionSink
+{
+    int detections;
+    int approaches;
+    int estimates;
+
+    CountingSink() : detections(0), approaches(0), estimates(0) {}
+
+    void on_detection(const detectssid::DetectionConstPtr&, const detectssid::BssRecord&) { ++detections; }
+    void on_closest_approach(const detectssid::ClosestApproachConstPtr&) { ++approaches; }
+    void on_estimate(const detectssid::PhoneEstimateConstPtr&) { ++estimates; }
+};
+
+/**
+ * @brief Runs warm_up cycles, then counts the allocations of cycles more
+ *
+ * @param[in] params - cycle settings
+ * @param[in] warm_up - cycles not counted
+ * @param[in] cycles - cycles counted
+ * @param[out] sink - messages of the counted cycles
+ *
+ * @return allocations of the counted cycles
+ */
+uint64_t steady_state_allocations(const detectssid::DetectionCycleParams& params, int warm_up,
+                                  int cycles, CountingSink& sink)
+{
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/tmp/detectssid_cycle_test_%d.txt", (int)getpid());
+
+    detectssid::IwlistBackend backend;
+    backend.configure(*detectssid::make_scan_config(std::shared_ptr<const detectssid::ScanConfig>(),
+                                                    kTarget, "wlan0", filename, 1.0, 10));
+    const detectssid::TargetMatcher matcher(kTarget);
+
+    detectssid::PoseHistory history(512, 0.5);
+    detectssid::PropagationMap propagation;
+    detectssid::DetectionCycle cycle(params, &history, &propagation, NULL);
+
+    uint64_t bssid;
+    detectssid::parse_bssid(kAmbient.bssid, 17, bssid);
+    cycle.ambient().reset(100, 0.001);
+    cycle.ambient().insert(bssid);
+
+    CountingSink warm_up_sink;
+    uint64_t allocations = 0;
+    for(int i = 1; i <= warm_up + cycles; ++i){
+        write_scan(filename, i);
+        push_poses(history, i);
+
+        uint64_t before = g_allocations.load(std::memory_order_relaxed);
+        backend.read(cycle.records());
+        cycle.run(ros::Time(scan_time(i)), matcher, i <= warm_up ? warm_up_sink : sink);
+        if(i > warm_up){
+            allocations += g_allocations.load(std::memory_order_relaxed) - before;
+        }
+    }
+    remove(filename);
+    return allocations;
+}
+
+detectssid::DetectionCycleParams test_params()
+{
+    detectssid::DetectionCycleParams params;
+    params.message_pool_size = 8;
+    params.max_networks = 16;
+    params.calibration_min_samples = 5;
+    params.particle_filter.particles = 500;
+
+    uint64_t bssid;
+    detectssid::parse_bssid(kBeacon.bssid, 17, bssid);
+    detectssid::PoseSample position = detectssid::PoseSample();
+    position.x = kBeacon.x;
+    position.y = kBeacon.y;
+    position.z = kBeacon.z;
+    params.calibration_beacons[bssid] = position;
+    return params;
+}
+
+} // namespace
+
+
+TEST(DetectionCycle, ParticleFilterSteadyStateDoesNotAllocate)
+{
+    detectssid::DetectionCycleParams params = test_params();
+    CountingSink sink;
+
+    EXPECT_EQ(0u, steady_state_allocations(params, 2 * kPathCycles, 2 * kPathCycles, sink));
+
+    // every part of the cycle had work
+    EXPECT_EQ(2 * 2 * kPathCycles, sink.detections);
+    EXPECT_GT(sink.approaches, 0);
+    EXPECT_GT(sink.estimates, 0);
+}
+
+TEST(DetectionCycle, GridLocalizerSteadyStateDoesNotAllocate)
+{
+    // the observation history grows up to max_history, then stops
+    detectssid::DetectionCycleParams params = test_params();
+    params.localizer = "grid";
+    params.grid.max_history = kPathCycles;
+    CountingSink sink;
+
+    EXPECT_EQ(0u, steady_state_allocations(params, 2 * kPathCycles, 2 * kPathCycles, sink));
+    EXPECT_EQ(2 * 2 * kPathCycles, sink.detections);
+    EXPECT_GT(sink.estimates, 0);
+}
+
+
+int main(int argc, char** argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}